@@ -0,0 +1,111 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <string.h>
+
+#include "adapt.h"
+
+static double
+ewma(double average, double sample)
+{
+    if (average == 0) return sample;
+    return average + ADAPT_EWMA_ALPHA * (sample - average);
+}
+
+void
+adapt_init(Adapt* adapt, size_t levels, double budget_ms)
+{
+    memset(adapt, 0, sizeof(*adapt));
+    adapt->levels    = levels < ADAPT_LEVELS ? levels : ADAPT_LEVELS;
+    adapt->budget_ns = (int64_t) (budget_ms * 1e6);
+    adapt->hold      = ADAPT_HOLD;
+    atomic_init(&adapt->level, 0);
+}
+
+size_t
+adapt_level(const Adapt* adapt)
+{
+    return atomic_load_explicit(&adapt->level, memory_order_relaxed);
+}
+
+// Moves to level, carrying over the expected difference in detector cost so
+// the latency reflects the new detector before it is measured, or starting
+// afresh on a detector that never ran.
+static void
+adapt_switch(Adapt* adapt, size_t from, size_t to)
+{
+    double before = adapt->detect_ns[from];
+    double after  = adapt->detect_ns[to];
+
+    adapt->frame_ns = after > 0 ? adapt->frame_ns + after - before : 0;
+    atomic_store_explicit(&adapt->level, to, memory_order_relaxed);
+    adapt->hold = ADAPT_HOLD;
+    adapt->switches++;
+}
+
+size_t
+adapt_update(Adapt* adapt, size_t level, int64_t frame_ns, int64_t detect_ns)
+{
+    if (level < adapt->levels && detect_ns >= 0) {
+        adapt->detect_ns[level] = ewma(adapt->detect_ns[level], detect_ns);
+        adapt->frames[level]++;
+    }
+    adapt->frame_ns = ewma(adapt->frame_ns, frame_ns);
+
+    size_t now = adapt_level(adapt);
+    if (adapt->hold > 0) {
+        adapt->hold--;
+        return now;
+    }
+
+    double budget = (double) adapt->budget_ns;
+    if (adapt->frame_ns > budget && now + 1 < adapt->levels) {
+        adapt_switch(adapt, now, now + 1);
+        return now + 1;
+    }
+    if (now > 0 && adapt->detect_ns[now] > 0) {
+        // The more accurate detector ran before stepping down from it.
+        double predicted = adapt->frame_ns - adapt->detect_ns[now] +
+                           adapt->detect_ns[now - 1];
+        if (predicted < budget * ADAPT_RECOVER) {
+            adapt_switch(adapt, now, now - 1);
+            return now - 1;
+        }
+    }
+
+    return now;
+}
+
+void
+adapt_print(const Adapt* adapt, FILE* out)
+{
+    fprintf(out,
+            "Adaptive detection: %.3f ms frames for a %.3f ms budget, "
+            "%llu switches, frames per detector",
+            adapt->frame_ns / 1e6,
+            adapt->budget_ns / 1e6,
+            (unsigned long long) adapt->switches);
+    for (size_t i = 0; i < adapt->levels; i++) {
+        fprintf(out,
+                "%s %llu (%.3f ms)",
+                i ? "," : "",
+                (unsigned long long) adapt->frames[i],
+                adapt->detect_ns[i] / 1e6);
+    }
+    fprintf(out, "\n");
+}
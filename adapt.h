@@ -0,0 +1,94 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Face detectors an adaptive pipeline chooses between.
+#define ADAPT_LEVELS 4
+
+// Weight of the latest frame in the smoothed latencies.
+#define ADAPT_EWMA_ALPHA 0.1
+
+// Frames a new detector runs before the latency is judged again.
+#define ADAPT_HOLD 10
+
+// Fraction of the budget the frames must be predicted to stay under on the
+// more accurate detector before returning to it.
+#define ADAPT_RECOVER 0.8
+
+/**
+ * Chooses between face detectors ordered from the most accurate and
+ * slowest, level 0, to the cheapest, so the smoothed frame latency stays
+ * within budget_ns.  Over budget it steps to the next cheaper detector.
+ * It steps back only once the frame latency minus the time the current
+ * detector takes plus the time the more accurate one took is below
+ * ADAPT_RECOVER of the budget.  It holds for ADAPT_HOLD frames at the start
+ * and after every switch, so the latency of the detector in use is known
+ * before moving again.
+ *
+ * adapt_update() is called by one thread at a time, once frames complete,
+ * while adapt_level() may be read by the thread detecting the next ones.
+ */
+typedef struct {
+    size_t        levels;                  // Detectors to choose from
+    atomic_size_t level;                   // Detector for the next frame
+    int64_t       budget_ns;               // Target frame latency
+    double        frame_ns;                // Smoothed frame latency
+    double        detect_ns[ADAPT_LEVELS]; // Smoothed cost of each detector
+    int           hold;                    // Frames left before judging again
+    uint64_t      switches;                // Times the level changed
+    uint64_t      frames[ADAPT_LEVELS];    // Frames detected at each level
+} Adapt;
+
+/**
+ * Prepares adapt for levels detectors, at most ADAPT_LEVELS, and a frame
+ * latency of budget_ms milliseconds, starting with the most accurate.
+ */
+void
+adapt_init(Adapt* adapt, size_t levels, double budget_ms);
+
+/**
+ * The detector the next frame should go through.
+ */
+size_t
+adapt_level(const Adapt* adapt);
+
+/**
+ * Folds a frame taking frame_ns into the latency, with detect_ns the time
+ * the detector at level took on it or a negative value when it did not run,
+ * such as for tracked frames, and picks the level of the next frame.
+ *
+ * Returns the level for the next frame.
+ */
+size_t
+adapt_update(Adapt* adapt, size_t level, int64_t frame_ns, int64_t detect_ns);
+
+/**
+ * Prints the smoothed latency against the budget, the switches and the
+ * frames detected at each level.
+ */
+void
+adapt_print(const Adapt* adapt, FILE* out);
+
+#endif /* ADAPT_H */
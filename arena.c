@@ -0,0 +1,116 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+int
+arena_init(Arena* arena, size_t size)
+{
+    memset(arena, 0, sizeof(*arena));
+    if (!size) return 0;
+
+    size = arena_size(size);
+    if (posix_memalign((void**) &arena->base, ARENA_ALIGN, size)) return -1;
+    memset(arena->base, 0, size);
+    arena->size = size;
+
+    return 0;
+}
+
+void*
+arena_alloc(Arena* arena, size_t size)
+{
+    size = arena_size(size);
+    if (size > arena->size - arena->used) return NULL;
+
+    void* memory = arena->base + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+void
+arena_release(Arena* arena)
+{
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+#ifdef ALLOC_STATS
+#include <errno.h>
+#include <stdatomic.h>
+
+// Interposes the allocator of the whole process, libraries included, and
+// forwards to the glibc implementation after counting.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* memory, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+static atomic_uint_fast64_t allocations;
+
+void*
+malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void*
+realloc(void* memory, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(memory, size);
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void** memory, size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    *memory = __libc_memalign(alignment, size);
+    return *memory ? 0 : ENOMEM;
+}
+
+uint64_t
+alloc_count(void)
+{
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+#else
+uint64_t
+alloc_count(void)
+{
+    return 0;
+}
+#endif
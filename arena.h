@@ -0,0 +1,79 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Alignment of every arena allocation, a cache line.
+#define ARENA_ALIGN 64
+
+/**
+ * A fixed block of memory handed out by bumping an offset.  It is sized once
+ * up front so buffers reused for every image never reach the heap again, and
+ * everything is returned at once by arena_release().
+ */
+typedef struct {
+    uint8_t* base;
+    size_t   size;
+    size_t   used;
+} Arena;
+
+/**
+ * Rounds size up to the arena alignment, used to add up the size of an
+ * arena from the buffers it will hold.
+ */
+static inline size_t
+arena_size(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+/**
+ * Allocates the size bytes of arena, zeroed.
+ *
+ * Returns 0 on success or -1 when out of memory.
+ */
+int
+arena_init(Arena* arena, size_t size);
+
+/**
+ * Takes size zeroed bytes from arena.
+ *
+ * Returns the memory or NULL when the arena is exhausted.
+ */
+void*
+arena_alloc(Arena* arena, size_t size);
+
+/**
+ * Releases the memory of arena and everything allocated from it.
+ */
+void
+arena_release(Arena* arena);
+
+/**
+ * Number of heap allocations made by the whole process so far, including
+ * those of libraries.  Only counted when built with ALLOC_STATS, otherwise
+ * always 0.
+ */
+uint64_t
+alloc_count(void);
+
+#endif /* ARENA_H */
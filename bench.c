@@ -0,0 +1,355 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "stats.h"
+
+static const char*
+pipeline_name(const Stages* stages)
+{
+    return stages->faces_ctx ? "two-stage" : "single-stage";
+}
+
+// Startup times are null when the inference they time did not happen.
+static void
+write_json_ms(FILE* out, const char* key, int64_t ns)
+{
+    if (ns < 0) {
+        fprintf(out, "  \"%s\": null,\n", key);
+    } else {
+        fprintf(out, "  \"%s\": %.6f,\n", key, ns / 1e6);
+    }
+}
+
+static int
+write_json(const Stats*       stats,
+           const Stages*      stages,
+           const BenchConfig* bench,
+           size_t             inputs,
+           FILE*              out)
+{
+    double seconds = stats_seconds(stats);
+
+    fprintf(out,
+            "{\n"
+            "  \"engine\": \"%s\",\n"
+            "  \"model\": \"%s\",\n"
+            "  \"pipeline\": \"%s\",\n"
+            "  \"inputs\": %zu,\n"
+            "  \"warmup\": %d,\n"
+            "  \"repeat\": %d,\n"
+            "  \"images\": %llu,\n"
+            "  \"faces\": %llu,\n"
+            "  \"seconds\": %.6f,\n"
+            "  \"images_per_sec\": %.3f,\n"
+            "  \"faces_per_sec\": %.3f,\n",
+            bench->engine,
+            bench->model,
+            pipeline_name(stages),
+            inputs,
+            bench->warmup,
+            bench->repeat,
+            (unsigned long long) stats->images,
+            (unsigned long long) stats->faces,
+            seconds,
+            seconds > 0 ? stats->images / seconds : 0.0,
+            seconds > 0 ? stats->faces / seconds : 0.0);
+    write_json_ms(out, "startup_ms", stages->open_ns);
+    write_json_ms(out, "first_pose_ms", stages->pose_warm_ns);
+    write_json_ms(out, "first_detect_ms", stages->faces_warm_ns);
+    fprintf(out, "  \"stages\": {");
+
+    const char* separator = "\n";
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram* h = &stats->stages[i];
+        if (!h->count) continue;
+        fprintf(out,
+                "%s    \"%s\": {\"count\": %llu, \"mean_ms\": %.6f, "
+                "\"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, "
+                "\"max_ms\": %.6f}",
+                separator,
+                stats_stage_name(i),
+                (unsigned long long) h->count,
+                h->sum / (double) h->count / 1e6,
+                histogram_percentile(h, 0.50) / 1e6,
+                histogram_percentile(h, 0.90) / 1e6,
+                histogram_percentile(h, 0.99) / 1e6,
+                h->max / 1e6);
+        separator = ",\n";
+    }
+    fprintf(out, "\n  }\n}\n");
+
+    return ferror(out) ? -1 : 0;
+}
+
+// One row per stage with the run throughput repeated, so reports of several
+// engines or models can simply be concatenated.
+static int
+write_csv(const Stats*       stats,
+          const Stages*      stages,
+          const BenchConfig* bench,
+          FILE*              out)
+{
+    double seconds = stats_seconds(stats);
+
+    fprintf(out,
+            "engine,model,pipeline,stage,count,mean_ms,p50_ms,p90_ms,"
+            "p99_ms,max_ms,images_per_sec,faces_per_sec\n");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram* h = &stats->stages[i];
+        if (!h->count) continue;
+        fprintf(out,
+                "%s,%s,%s,%s,%llu,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f\n",
+                bench->engine,
+                bench->model,
+                pipeline_name(stages),
+                stats_stage_name(i),
+                (unsigned long long) h->count,
+                h->sum / (double) h->count / 1e6,
+                histogram_percentile(h, 0.50) / 1e6,
+                histogram_percentile(h, 0.90) / 1e6,
+                histogram_percentile(h, 0.99) / 1e6,
+                h->max / 1e6,
+                seconds > 0 ? stats->images / seconds : 0.0,
+                seconds > 0 ? stats->faces / seconds : 0.0);
+    }
+
+    // Startup is measured once, as rows of a single sample.
+    const struct {
+        const char* name;
+        int64_t     ns;
+    } startup[] = {
+        {"startup", stages->open_ns},
+        {"first_pose", stages->pose_warm_ns},
+        {"first_detect", stages->faces_warm_ns},
+    };
+    for (size_t i = 0; i < sizeof(startup) / sizeof(startup[0]); i++) {
+        if (startup[i].ns < 0) continue;
+        double ms = startup[i].ns / 1e6;
+        fprintf(out,
+                "%s,%s,%s,%s,1,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f\n",
+                bench->engine,
+                bench->model,
+                pipeline_name(stages),
+                startup[i].name,
+                ms,
+                ms,
+                ms,
+                ms,
+                ms,
+                seconds > 0 ? stats->images / seconds : 0.0,
+                seconds > 0 ? stats->faces / seconds : 0.0);
+    }
+
+    return ferror(out) ? -1 : 0;
+}
+
+static int
+write_report(const Stats*       stats,
+             const Stages*      stages,
+             const BenchConfig* bench,
+             size_t             inputs)
+{
+    FILE* out = fopen(bench->report, "w");
+    if (!out) {
+        fprintf(stderr,
+                "failed to open %s: %s\n",
+                bench->report,
+                strerror(errno));
+        return -1;
+    }
+
+    size_t len = strlen(bench->report);
+    int    err = len > 4 && strcmp(bench->report + len - 4, ".csv") == 0
+                     ? write_csv(stats, stages, bench, out)
+                     : write_json(stats, stages, bench, inputs, out);
+    if (fclose(out) || err) {
+        fprintf(stderr,
+                "failed to write %s: %s\n",
+                bench->report,
+                strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Times loading every crop of job into the head pose input from the image
+// file and from the decoded frame through VAAL and with the preprocess
+// kernel, the ways pose_batch_run() may fill it.  Frames reduced for the
+// detector are timed on the full resolution region decoded by stage_pose().
+static int
+bench_crops(const Stages* stages, const Job* job, int repeat, Stats* stats)
+{
+    PoseBatch*   pose   = stages->pose;
+    NNTensor*    slot   = pose->slots ? pose->slots[0] : NULL;
+    size_t       count  = job->face_detect ? job->num_boxes : 1;
+    bool         region = job->encoded && job->num_boxes;
+    const Frame* frame  = region ? &job->region : &job->frame;
+    Histogram*   h      = stats->stages;
+    VAALError    err;
+    int64_t      start;
+
+    for (size_t j = 0; j < count; j++) {
+        const int32_t* roi  = job->face_detect ? job->rois[j] : NULL;
+        const int32_t* crop = region ? job->region_rois[j] : roi;
+
+        for (int i = 0; i < repeat; i++) {
+            start = vaal_clock_now();
+            err   = vaal_load_image_file(pose->ctx, slot, job->path, roi, 0);
+            if (err) goto fail;
+            histogram_add(&h[STAT_CROP_FILE], vaal_clock_now() - start);
+
+            start = vaal_clock_now();
+            err   = frame_load_tensor(pose->ctx, slot, frame, crop);
+            if (err) goto fail;
+            histogram_add(&h[STAT_CROP_FRAME], vaal_clock_now() - start);
+
+            start = vaal_clock_now();
+            if (!preprocess_load(pose->preprocess,
+                                 slot ? slot : pose->input,
+                                 frame,
+                                 crop)) {
+                histogram_add(&h[STAT_CROP_KERNEL], vaal_clock_now() - start);
+            }
+        }
+    }
+
+    return 0;
+
+fail:
+    fprintf(stderr, "failed to load crop: %s\n", vaal_strerror(err));
+    return -1;
+}
+
+// Times reading the resolution of the image at path through VAAL and from
+// the header of a mapping of the file, what stage_decode() needs to scale
+// boxes when frames are not shared.  Images VAAL cannot probe only time the
+// header.
+static int
+bench_probe(const char* path, int repeat, Stats* stats)
+{
+    Histogram* h    = stats->stages;
+    bool       vaal = true;
+    int32_t    width, height;
+    int64_t    start;
+
+    for (int i = 0; i < repeat; i++) {
+        if (vaal) {
+            start         = vaal_clock_now();
+            VAALError err = vaal_image_file_resolution(path, &width, &height);
+            if (err) {
+                fprintf(stderr,
+                        "failed to probe %s through VAAL: %s\n",
+                        path,
+                        vaal_strerror(err));
+                vaal = false;
+            } else {
+                histogram_add(&h[STAT_PROBE_VAAL], vaal_clock_now() - start);
+            }
+        }
+
+        start = vaal_clock_now();
+        if (frame_probe_file(path, &width, &height)) {
+            fprintf(stderr, "failed to probe %s: %s\n", path, frame_error());
+            return -1;
+        }
+        histogram_add(&h[STAT_PROBE_HEADER], vaal_clock_now() - start);
+    }
+
+    return 0;
+}
+
+int
+bench_run(const Stages* stages, const BenchConfig* bench, Input* input)
+{
+    Stages      shared = *stages;
+    Job         job;
+    Stats*      stats  = calloc(1, sizeof(Stats));
+    size_t      inputs = 0;
+    int         err    = 0;
+    const char* path;
+
+    shared.shared_frame = true;
+    // Every repetition must run the detector on the same image.
+    shared.tracker    = NULL;
+    shared.pose_cache = NULL;
+
+    if (!stats || job_init(&job, stages->max_detection)) {
+        fprintf(stderr, "failed to allocate benchmark: %s\n", strerror(errno));
+        free(stats);
+        return -1;
+    }
+    stats_init(stats);
+
+    while (!err && (path = input_next(input))) {
+        snprintf(job.path, sizeof(job.path), "%s", path);
+        if (stage_decode(&shared, &job)) {
+            err = -1;
+            break;
+        }
+        histogram_add(&stats->stages[STAT_DECODE], job.decode_ns);
+        inputs++;
+
+        if (bench->probe && bench_probe(job.path, bench->repeat, stats)) {
+            err = -1;
+            break;
+        }
+
+        for (int i = 0; i < bench->warmup + bench->repeat; i++) {
+            job_reset(&shared, &job);
+            job.decode_ns = -1;
+
+            int64_t start = vaal_clock_now();
+            if (stage_detect(&shared, &job) || stage_pose(&shared, &job)) {
+                err = -1;
+                break;
+            }
+            int64_t elapsed = vaal_clock_now() - start;
+
+            if (i < bench->warmup) continue;
+            stats_add_job(stats, &job, -1);
+            stats->elapsed_ns += elapsed;
+        }
+
+        if (!err && stages->pose->preprocess) {
+            err = bench_crops(stages, &job, bench->repeat, stats);
+        }
+    }
+    if (input->error) err = -1;
+
+    if (!err && stats->images) {
+        printf("Benchmark: %s pipeline, %zu inputs, %d warm-up and %d timed "
+               "iterations each\n",
+               pipeline_name(stages),
+               inputs,
+               bench->warmup,
+               bench->repeat);
+        stats_print(stats, stdout);
+        if (bench->report) err = write_report(stats, stages, bench, inputs);
+    }
+
+    job_release(&job);
+    free(stats);
+
+    return err;
+}
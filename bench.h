@@ -0,0 +1,51 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+
+#include "input.h"
+#include "stages.h"
+
+/**
+ * Settings of the --benchmark mode.
+ */
+typedef struct {
+    int         warmup; // Untimed iterations run first for every input
+    int         repeat; // Timed iterations for every input
+    const char* report; // JSON report, or CSV when ending in .csv, or NULL
+    const char* engine; // Engine name recorded in the report
+    const char* model;  // Head pose model recorded in the report
+    bool        probe;  // Also time the resolution probes of every input
+} BenchConfig;
+
+/**
+ * Benchmarks the stages over every image of input.  Each image is decoded
+ * once and kept in memory, then run through detection and head pose
+ * bench->warmup times untimed followed by bench->repeat timed iterations,
+ * so file I/O and decoding stay out of the inference figures.  The summary
+ * is printed to stdout and written to bench->report when set.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+bench_run(const Stages* stages, const BenchConfig* bench, Input* input);
+
+#endif /* BENCH_H */
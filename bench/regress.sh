@@ -0,0 +1,166 @@
+#!/bin/sh
+#
+# Regression suite run by make bench: checks the head pose of every image in
+# IMAGES against the golden results recorded for each engine and
+# the throughput and latency of --benchmark against the recorded baseline.
+#
+#   ENGINES          Engines to run, by default "npu cpu"
+#   IMAGES           List of the images, one per line, bench/images.txt
+#   MODEL            Head pose model, by default appconfig_0/headpose.rtm
+#   VAAL_MODEL_PATH  Where the face detector is found, appconfig_0 by default
+#   ANGLE_TOL        Largest yaw, pitch or roll drift in degrees, 1.0
+#   BOX_TOL          Largest box drift as a fraction of the image, 0.01
+#   MAX_REGRESS      Largest throughput or latency regression in %, 10
+#   UPDATE=1         Record the golden results and baseline instead
+#
+# Exits with 1 when any engine drifts or regresses.
+
+set -eu
+
+cd "$(dirname "$0")/.."
+
+ENGINES=${ENGINES:-npu cpu}
+IMAGES=${IMAGES:-bench/images.txt}
+MODEL=${MODEL:-appconfig_0/headpose.rtm}
+VAAL_MODEL_PATH=${VAAL_MODEL_PATH:-appconfig_0}
+ANGLE_TOL=${ANGLE_TOL:-1.0}
+BOX_TOL=${BOX_TOL:-0.01}
+MAX_REGRESS=${MAX_REGRESS:-10}
+UPDATE=${UPDATE:-}
+export VAAL_MODEL_PATH
+
+GOLDEN=bench/golden
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Prints the value of key from the --report JSON of a benchmark, or of key
+# of stage when given.
+report_value() {
+    awk -v key="\"$2\":" -v stage="${3:+\"$3\":}" '
+        stage != "" && index($0, stage) == 0 { next }
+        {
+            at = index($0, key)
+            if (!at) next
+            rest = substr($0, at + length(key))
+            sub(/^ */, "", rest)
+            sub(/[,}].*$/, "", rest)
+            print rest
+            exit
+        }' "$1"
+}
+
+# Compares the CSV results of run against golden face by face, printing
+# every face past the tolerances.  Fails when any is or the faces differ.
+compare_results() {
+    awk -F, -v angle="$ANGLE_TOL" -v box="$BOX_TOL" '
+        function abs(x) { return x < 0 ? -x : x }
+        function drift(a, b, tol) {
+            # Skipped faces have empty angles in both or neither.
+            if (a == "" || b == "") return a != b
+            return abs(a - b) > tol
+        }
+        NR == FNR { golden[FNR] = $0; rows = FNR; next }
+        {
+            if (!(FNR in golden)) {
+                printf "unexpected face: %s\n", $0
+                failed = 1
+                next
+            }
+            split(golden[FNR], g, ",")
+            if (g[1] != $1 || g[2] != $2) {
+                printf "expected %s face %s, got %s face %s\n",
+                       g[1], g[2], $1, $2
+                failed = 1
+                next
+            }
+            bad = 0
+            for (i = 4; i <= 7; i++) bad = bad || drift($i, g[i], box)
+            for (i = 9; i <= 11; i++) bad = bad || drift($i, g[i], angle)
+            if (bad) {
+                printf "%s face %s drifted:\n  golden %s\n  now    %s\n",
+                       $1, $2, golden[FNR], $0
+                failed = 1
+            }
+        }
+        END {
+            if (FNR < rows) {
+                printf "%d golden faces missing\n", rows - FNR
+                failed = 1
+            }
+            exit failed
+        }' "$1" "$2"
+}
+
+# Fails when now is more than MAX_REGRESS % worse than base, higher being
+# better when sense is 1 and worse when it is -1.
+check_regress() {
+    awk -v name="$1" -v base="$2" -v now="$3" -v sense="$4" \
+        -v max="$MAX_REGRESS" '
+        BEGIN {
+            change = (now - base) / base * 100 * sense
+            printf "  %-16s %12.3f baseline %12.3f (%+.1f%%)\n",
+                   name, now, base, change
+            exit change < -max
+        }'
+}
+
+status=0
+for engine in $ENGINES; do
+    echo "Engine $engine"
+    results="$TMP/$engine.csv"
+    report="$TMP/$engine.json"
+
+    # Written to a file first so a failing run is not hidden by the pipe
+    # stripping the CSV header.
+    if ! ./headposeimg -e "$engine" -l "$IMAGES" --output_format csv \
+             "$MODEL" > "$TMP/$engine.out" ||
+       ! ./headposeimg -e "$engine" -l "$IMAGES" -b --warmup 5 \
+             --repeat 20 --report "$report" "$MODEL" > /dev/null; then
+        echo "  headposeimg failed"
+        status=1
+        continue
+    fi
+    tail -n +2 "$TMP/$engine.out" > "$results"
+
+    throughput=$(report_value "$report" images_per_sec)
+    latency=$(report_value "$report" p50_ms frame)
+
+    if [ -n "$UPDATE" ]; then
+        mkdir -p "$GOLDEN"
+        cp "$results" "$GOLDEN/$engine.csv"
+        printf 'images_per_sec %s\nframe_p50_ms %s\n' \
+            "$throughput" "$latency" > "$GOLDEN/$engine.perf"
+        echo "  recorded $(wc -l < "$results") faces," \
+             "$throughput images/s, $latency ms per frame"
+        # Batching, the face gate and the scheduler only show with more
+        # than one face in an image.
+        if ! awk -F, '++faces[$1] > 1 { found = 1 } END { exit !found }' \
+                 "$results"; then
+            echo "  warning: no image has more than one face, add some to" \
+                 "$IMAGES"
+        fi
+        continue
+    fi
+
+    if [ ! -f "$GOLDEN/$engine.csv" ] || [ ! -f "$GOLDEN/$engine.perf" ]; then
+        echo "  no golden results, record them with make bench-golden"
+        status=1
+        continue
+    fi
+
+    if compare_results "$GOLDEN/$engine.csv" "$results"; then
+        echo "  $(wc -l < "$results") faces within $ANGLE_TOL degrees"
+    else
+        status=1
+    fi
+
+    base_throughput=$(awk '$1 == "images_per_sec" { print $2 }' \
+                          "$GOLDEN/$engine.perf")
+    base_latency=$(awk '$1 == "frame_p50_ms" { print $2 }' \
+                       "$GOLDEN/$engine.perf")
+    check_regress images_per_sec "$base_throughput" "$throughput" 1 ||
+        status=1
+    check_regress frame_p50_ms "$base_latency" "$latency" -1 || status=1
+done
+
+exit $status
@@ -0,0 +1,384 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <linux/videodev2.h>
+
+#include "camera.h"
+
+// How often the capture thread checks whether it must stop.
+#define CAMERA_POLL_MS 100
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void
+on_signal(int signum)
+{
+    (void) signum;
+    interrupted = 1;
+}
+
+static int
+xioctl(int fd, unsigned long request, void* arg)
+{
+    int err;
+    do {
+        err = ioctl(fd, request, arg);
+    } while (err == -1 && errno == EINTR);
+    return err;
+}
+
+static int
+camera_queue(Camera* camera, int index)
+{
+    struct v4l2_buffer buf = {
+        .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = V4L2_MEMORY_MMAP,
+        .index  = index,
+    };
+
+    if (xioctl(camera->fd, VIDIOC_QBUF, &buf)) {
+        fprintf(stderr,
+                "failed to queue %s buffer: %s\n",
+                camera->device,
+                strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+camera_stop(Camera* camera, bool failed)
+{
+    pthread_mutex_lock(&camera->lock);
+    camera->stopping = true;
+    camera->failed |= failed;
+    pthread_cond_broadcast(&camera->ready);
+    pthread_mutex_unlock(&camera->lock);
+}
+
+static void*
+camera_capture(void* arg)
+{
+    Camera*       camera = arg;
+    struct pollfd pfd    = {.fd = camera->fd, .events = POLLIN};
+
+    for (;;) {
+        pthread_mutex_lock(&camera->lock);
+        bool stopping = camera->stopping;
+        pthread_mutex_unlock(&camera->lock);
+        if (stopping) break;
+        if (interrupted) {
+            camera_stop(camera, false);
+            break;
+        }
+
+        int ready = poll(&pfd, 1, CAMERA_POLL_MS);
+        if (ready == -1 && errno != EINTR) {
+            fprintf(stderr,
+                    "failed to wait for %s: %s\n",
+                    camera->device,
+                    strerror(errno));
+            camera_stop(camera, true);
+            break;
+        }
+        if (ready <= 0) continue;
+
+        struct v4l2_buffer buf = {
+            .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = V4L2_MEMORY_MMAP,
+        };
+        if (xioctl(camera->fd, VIDIOC_DQBUF, &buf)) {
+            if (errno == EAGAIN) continue;
+            fprintf(stderr,
+                    "failed to capture from %s: %s\n",
+                    camera->device,
+                    strerror(errno));
+            camera_stop(camera, true);
+            break;
+        }
+
+        CameraBuffer* buffer = &camera->buffers[buf.index];
+
+        pthread_mutex_lock(&camera->lock);
+        // Gaps in the sequence are frames the driver had nowhere to put.
+        if (camera->captured && buf.sequence > camera->sequence + 1) {
+            camera->dropped += buf.sequence - camera->sequence - 1;
+        }
+        camera->sequence    = buf.sequence;
+        buffer->sequence    = buf.sequence;
+        buffer->captured_ns = vaal_clock_now();
+        camera->captured++;
+
+        // Latest frame wins, the one still waiting is stale.
+        int stale      = camera->latest;
+        camera->latest = buf.index;
+        if (stale >= 0) camera->dropped++;
+        pthread_cond_signal(&camera->ready);
+        pthread_mutex_unlock(&camera->lock);
+
+        if (stale >= 0 && camera_queue(camera, stale)) {
+            camera_stop(camera, true);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int
+camera_open(Camera*     camera,
+            const char* device,
+            int32_t     width,
+            int32_t     height,
+            uint32_t    fourcc)
+{
+    memset(camera, 0, sizeof(*camera));
+    camera->device = device;
+    camera->latest = -1;
+
+    camera->fd = open(device, O_RDWR | O_NONBLOCK);
+    if (camera->fd == -1) {
+        fprintf(stderr, "failed to open %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+
+    struct v4l2_capability cap;
+    if (xioctl(camera->fd, VIDIOC_QUERYCAP, &cap) ||
+        !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+        !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        fprintf(stderr, "%s is not a streaming capture device\n", device);
+        close(camera->fd);
+        return -1;
+    }
+
+    struct v4l2_format fmt = {.type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
+    fmt.fmt.pix.width       = width;
+    fmt.fmt.pix.height      = height;
+    fmt.fmt.pix.pixelformat = fourcc;
+    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+    if (xioctl(camera->fd, VIDIOC_S_FMT, &fmt)) {
+        fprintf(stderr,
+                "failed to set %s format: %s\n",
+                device,
+                strerror(errno));
+        close(camera->fd);
+        return -1;
+    }
+    // V4L2 pixel formats share the FOURCC encoding used by VAAL.
+    camera->fourcc = fmt.fmt.pix.pixelformat;
+    camera->width  = fmt.fmt.pix.width;
+    camera->height = fmt.fmt.pix.height;
+
+    struct v4l2_requestbuffers req = {
+        .count  = CAMERA_BUFFERS,
+        .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = V4L2_MEMORY_MMAP,
+    };
+    if (xioctl(camera->fd, VIDIOC_REQBUFS, &req) || req.count < 2) {
+        fprintf(stderr,
+                "failed to allocate %s buffers: %s\n",
+                device,
+                req.count < 2 ? "too few buffers" : strerror(errno));
+        close(camera->fd);
+        return -1;
+    }
+    camera->num_buffers = MIN(req.count, CAMERA_BUFFERS);
+
+    pthread_mutex_init(&camera->lock, NULL);
+    pthread_cond_init(&camera->ready, NULL);
+
+    for (uint32_t i = 0; i < camera->num_buffers; i++) {
+        CameraBuffer*      buffer = &camera->buffers[i];
+        struct v4l2_buffer buf    = {
+            .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = V4L2_MEMORY_MMAP,
+            .index  = i,
+        };
+        if (xioctl(camera->fd, VIDIOC_QUERYBUF, &buf)) goto fail;
+
+        buffer->length = buf.length;
+        buffer->data   = mmap(NULL,
+                              buf.length,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED,
+                              camera->fd,
+                              buf.m.offset);
+        if (buffer->data == MAP_FAILED) {
+            buffer->data = NULL;
+            goto fail;
+        }
+
+        // Without export frames are still loaded from the mapping.
+        struct v4l2_exportbuffer exp = {
+            .type  = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .index = i,
+            .flags = O_RDONLY | O_CLOEXEC,
+        };
+        if (xioctl(camera->fd, VIDIOC_EXPBUF, &exp) == 0) {
+            buffer->dmabuf = exp.fd;
+        }
+
+        if (xioctl(camera->fd, VIDIOC_QBUF, &buf)) goto fail;
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(camera->fd, VIDIOC_STREAMON, &type)) goto fail;
+
+    int err = pthread_create(&camera->thread, NULL, camera_capture, camera);
+    if (err) {
+        xioctl(camera->fd, VIDIOC_STREAMOFF, &type);
+        errno = err;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    fprintf(stderr, "failed to start %s: %s\n", device, strerror(errno));
+    for (uint32_t i = 0; i < camera->num_buffers; i++) {
+        if (camera->buffers[i].dmabuf) close(camera->buffers[i].dmabuf);
+        if (camera->buffers[i].data) {
+            munmap(camera->buffers[i].data, camera->buffers[i].length);
+        }
+    }
+    pthread_cond_destroy(&camera->ready);
+    pthread_mutex_destroy(&camera->lock);
+    close(camera->fd);
+    return -1;
+}
+
+int
+camera_next(Camera* camera, Frame* frame)
+{
+    pthread_mutex_lock(&camera->lock);
+    while (camera->latest < 0 && !camera->stopping) {
+        pthread_cond_wait(&camera->ready, &camera->lock);
+    }
+    int index      = camera->stopping ? -1 : camera->latest;
+    camera->latest = -1;
+    pthread_mutex_unlock(&camera->lock);
+
+    if (index < 0) return -1;
+
+    const CameraBuffer* buffer = &camera->buffers[index];
+    frame->data                = buffer->data;
+    frame->width               = camera->width;
+    frame->height              = camera->height;
+    frame->fourcc              = camera->fourcc;
+    frame->dmabuf              = buffer->dmabuf;
+
+    return index;
+}
+
+void
+camera_requeue(Camera* camera, int index)
+{
+    if (camera_queue(camera, index)) camera_stop(camera, true);
+}
+
+void
+camera_close(Camera* camera)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    camera_stop(camera, false);
+    pthread_join(camera->thread, NULL);
+    xioctl(camera->fd, VIDIOC_STREAMOFF, &type);
+
+    for (uint32_t i = 0; i < camera->num_buffers; i++) {
+        if (camera->buffers[i].dmabuf) close(camera->buffers[i].dmabuf);
+        munmap(camera->buffers[i].data, camera->buffers[i].length);
+    }
+
+    pthread_cond_destroy(&camera->ready);
+    pthread_mutex_destroy(&camera->lock);
+    close(camera->fd);
+}
+
+int
+camera_run(const Stages*  stages,
+           Camera*        camera,
+           uint64_t       frames,
+           PipelineOutput output,
+           void*          user)
+{
+    // Frames only exist in memory, there is no file to reload.
+    Stages shared       = *stages;
+    shared.shared_frame = true;
+
+    Job job;
+    if (job_init(&job, stages->max_detection)) {
+        fprintf(stderr, "failed to allocate job: %s\n", strerror(errno));
+        return -1;
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int status = 0;
+    for (uint64_t n = 0; !frames || n < frames; n++) {
+        int index = camera_next(camera, &job.frame);
+        if (index < 0) break;
+
+        const CameraBuffer* buffer = &camera->buffers[index];
+        snprintf(job.path,
+                 sizeof(job.path),
+                 "%s:%" PRIu32,
+                 camera->device,
+                 buffer->sequence);
+        job_reset(&shared, &job);
+        job.width     = job.frame.width;
+        job.height    = job.frame.height;
+        job.decode_ns = job.start_ns - buffer->captured_ns;
+        job.start_ns  = buffer->captured_ns;
+
+        int err = stage_detect(&shared, &job) || stage_pose(&shared, &job);
+
+        // Reported before requeuing so the output may still use the pixels,
+        // which belong to the driver again once requeued.
+        if (!err) output(&job, user);
+        memset(&job.frame, 0, sizeof(job.frame));
+        camera_requeue(camera, index);
+
+        if (err) {
+            status = -1;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&camera->lock);
+    if (camera->failed) status = -1;
+    pthread_mutex_unlock(&camera->lock);
+
+    job_release(&job);
+    return status;
+}
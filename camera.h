@@ -0,0 +1,122 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "pipeline.h"
+#include "stages.h"
+
+// Capture buffers shared with the driver, one is processed while one holds
+// the newest frame and the others are being filled.
+#define CAMERA_BUFFERS 4
+
+typedef struct {
+    void*    data;        // Buffer mapped into our address space
+    size_t   length;      // Size of the mapping
+    int      dmabuf;      // Exported DMA buffer, 0 when export failed
+    uint32_t sequence;    // Driver sequence number of the frame
+    int64_t  captured_ns; // Clock when the frame was dequeued
+} CameraBuffer;
+
+/**
+ * A V4L2 capture device streaming into memory mapped buffers.  A capture
+ * thread keeps only the newest frame: when the consumer is slow the frame
+ * it has not taken yet is handed back to the driver and counted as dropped,
+ * so processing never falls behind the live feed by more than one frame.
+ */
+typedef struct {
+    const char*     device;
+    int             fd;
+    uint32_t        fourcc;      // Pixel format agreed with the driver
+    int32_t         width;
+    int32_t         height;
+    uint32_t        num_buffers;
+    CameraBuffer    buffers[CAMERA_BUFFERS];
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    int             latest;      // Newest buffer not yet taken or -1
+    bool            stopping;    // Capture thread must stop
+    bool            failed;      // Capture stopped because of an error
+    uint64_t        captured;    // Frames received from the driver
+    uint64_t        dropped;     // Frames replaced or lost by the driver
+    uint32_t        sequence;    // Driver sequence of the newest frame
+} Camera;
+
+/**
+ * Opens the V4L2 device, such as /dev/video0, asks for width x height
+ * frames in the fourcc pixel format, which the driver may adjust, and starts
+ * streaming.  Buffers are exported as DMA buffers when the driver supports
+ * it so frames are imported into the models without a copy.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+camera_open(Camera*     camera,
+            const char* device,
+            int32_t     width,
+            int32_t     height,
+            uint32_t    fourcc);
+
+/**
+ * Waits for a frame newer than the last one taken and points frame at it,
+ * the frame remains valid until camera_requeue() of the returned buffer.
+ *
+ * Returns the buffer index or -1 once the camera stopped.
+ */
+int
+camera_next(Camera* camera, Frame* frame);
+
+/**
+ * Hands the buffer index returned by camera_next() back to the driver.
+ */
+void
+camera_requeue(Camera* camera, int index);
+
+/**
+ * Stops streaming and releases the device.
+ */
+void
+camera_close(Camera* camera);
+
+/**
+ * Runs face detection and head pose on the live frames of camera until
+ * frames have been processed, or SIGINT or SIGTERM when frames is 0, and
+ * passes every job to output.  Jobs are named after the device and the
+ * driver sequence number and their decode time is the time the frame
+ * waited to be processed since nothing needs decoding.  The frame of the
+ * job is still the capture buffer while output runs.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+camera_run(const Stages*  stages,
+           Camera*        camera,
+           uint64_t       frames,
+           PipelineOutput output,
+           void*          user);
+
+#endif /* CAMERA_H */
@@ -0,0 +1,469 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "frame.h"
+#include "mapfile.h"
+
+static __thread const char* last_error = NULL;
+
+// Routes libjpeg failures back to the decoding call instead of exit().
+typedef struct {
+    struct jpeg_error_mgr mgr;
+    jmp_buf               jump;
+} JpegError;
+
+static __thread char jpeg_message[JMSG_LENGTH_MAX];
+static __thread char png_message[64]; // As long as png_image.message
+
+static void
+jpeg_error_exit(j_common_ptr cinfo)
+{
+    JpegError* error = (JpegError*) cinfo->err;
+    (*cinfo->err->format_message)(cinfo, jpeg_message);
+    last_error = jpeg_message;
+    longjmp(error->jump, 1);
+}
+
+// Corrupt data warnings are not worth a message per image.
+static void
+jpeg_output_message(j_common_ptr cinfo)
+{
+    (void) cinfo;
+}
+
+// Reads the header of the JPEG at data into cinfo for RGB output, on failure
+// the caller's setjmp() on error->jump returns again.
+static void
+jpeg_open(struct jpeg_decompress_struct* cinfo,
+          JpegError*                     error,
+          const uint8_t*                 data,
+          size_t                         size)
+{
+    cinfo->err                  = jpeg_std_error(&error->mgr);
+    error->mgr.error_exit       = jpeg_error_exit;
+    error->mgr.output_message   = jpeg_output_message;
+    jpeg_create_decompress(cinfo);
+    jpeg_mem_src(cinfo, data, (unsigned long) size);
+    jpeg_read_header(cinfo, TRUE);
+    cinfo->out_color_space = JCS_RGB;
+}
+
+// Reads rows scanlines of cinfo->output_width pixels into frame.
+static void
+jpeg_read_rows(struct jpeg_decompress_struct* cinfo,
+               Frame*                         frame,
+               JDIMENSION                     rows)
+{
+    size_t stride = (size_t) cinfo->output_width * 3;
+
+    for (JDIMENSION y = 0; y < rows;) {
+        JSAMPROW row = frame->data + y * stride;
+        y += jpeg_read_scanlines(cinfo, &row, 1);
+    }
+}
+
+// Sizes frame for width by height RGB3 pixels, reusing the buffer it
+// already holds when large enough so that decoding image after image only
+// allocates for a larger one.
+static int
+frame_alloc(Frame* frame, int32_t width, int32_t height)
+{
+    size_t size = (size_t) width * height * 3;
+
+    if (!frame->heap || frame->capacity < size) {
+        frame_release(frame);
+        frame->data = malloc(size);
+        if (!frame->data) {
+            last_error = strerror(ENOMEM);
+            return -1;
+        }
+        frame->heap     = true;
+        frame->capacity = size;
+    }
+    frame->width  = width;
+    frame->height = height;
+    frame->fourcc = FOURCC('R', 'G', 'B', '3');
+    return 0;
+}
+
+// Empties frame before a decode, keeping a buffer of its own for reuse.
+static void
+frame_empty(Frame* frame)
+{
+    if (!frame->heap) {
+        frame_release(frame);
+        return;
+    }
+    frame->width  = 0;
+    frame->height = 0;
+}
+
+static bool
+is_png(const uint8_t* data, size_t size)
+{
+    return size >= 8 && !png_sig_cmp(data, 0, 8);
+}
+
+// Reads the header of the PNG at data into image, ready for RGB output.
+static int
+png_open(png_image* image, const uint8_t* data, size_t size)
+{
+    memset(image, 0, sizeof(*image));
+    image->version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(image, data, size)) {
+        snprintf(png_message, sizeof(png_message), "%s", image->message);
+        last_error = png_message;
+        png_image_free(image);
+        return -1;
+    }
+    image->format = PNG_FORMAT_RGB;
+    return 0;
+}
+
+static int
+png_decode(Frame* frame, const uint8_t* data, size_t size)
+{
+    png_image image;
+
+    if (png_open(&image, data, size)) return -1;
+    if (frame_alloc(frame, (int32_t) image.width, (int32_t) image.height)) {
+        png_image_free(&image);
+        return -1;
+    }
+    // Both outcomes release the decoder.
+    if (!png_image_finish_read(&image, NULL, frame->data, 0, NULL)) {
+        snprintf(png_message, sizeof(png_message), "%s", image.message);
+        last_error = png_message;
+        frame_empty(frame);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+frame_load_file(Frame* frame, const char* path)
+{
+    MappedFile file;
+
+    frame_empty(frame);
+
+    // Decoding straight from the mapping spares stdio its read buffer.
+    if (mapped_file_open(&file, path)) {
+        last_error = strerror(errno);
+        return -1;
+    }
+    int err = frame_load_memory(frame, file.data, file.size);
+    mapped_file_close(&file);
+
+    return err;
+}
+
+int
+frame_load_memory(Frame* frame, const uint8_t* data, size_t size)
+{
+    int32_t width, height;
+
+    if (frame_is_jpeg(data, size)) {
+        // No image is that large, so the JPEG is decoded at full resolution.
+        return frame_load_jpeg_scaled(frame,
+                                      data,
+                                      size,
+                                      INT32_MAX,
+                                      INT32_MAX,
+                                      &width,
+                                      &height);
+    }
+
+    frame_empty(frame);
+    if (!is_png(data, size)) {
+        last_error = "unsupported image format, expected JPEG or PNG";
+        return -1;
+    }
+    return png_decode(frame, data, size);
+}
+
+int
+frame_probe_file(const char* path, int32_t* width, int32_t* height)
+{
+    MappedFile file;
+
+    if (mapped_file_open(&file, path)) {
+        last_error = strerror(errno);
+        return -1;
+    }
+    int err = frame_probe_memory(file.data, file.size, width, height);
+    mapped_file_close(&file);
+
+    return err;
+}
+
+int
+frame_probe_memory(const uint8_t* data,
+                   size_t         size,
+                   int32_t*       width,
+                   int32_t*       height)
+{
+    if (frame_is_jpeg(data, size)) {
+        struct jpeg_decompress_struct cinfo;
+        JpegError                     error;
+
+        // Parses the JPEG markers up to the start of the scan.
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&cinfo);
+            return -1;
+        }
+        jpeg_open(&cinfo, &error, data, size);
+        *width  = (int32_t) cinfo.image_width;
+        *height = (int32_t) cinfo.image_height;
+        jpeg_destroy_decompress(&cinfo);
+        return 0;
+    }
+
+    if (!is_png(data, size)) {
+        last_error = "unsupported image format, expected JPEG or PNG";
+        return -1;
+    }
+
+    // Parses the PNG IHDR.
+    png_image image;
+    if (png_open(&image, data, size)) return -1;
+    *width  = (int32_t) image.width;
+    *height = (int32_t) image.height;
+    png_image_free(&image);
+
+    return 0;
+}
+
+bool
+frame_is_jpeg(const uint8_t* data, size_t size)
+{
+    return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+int
+frame_load_jpeg_scaled(Frame*         frame,
+                       const uint8_t* data,
+                       size_t         size,
+                       int32_t        min_width,
+                       int32_t        min_height,
+                       int32_t*       width,
+                       int32_t*       height)
+{
+    struct jpeg_decompress_struct cinfo;
+    JpegError                     error;
+
+    frame_empty(frame);
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        frame_empty(frame);
+        return -1;
+    }
+    jpeg_open(&cinfo, &error, data, size);
+
+    *width  = (int32_t) cinfo.image_width;
+    *height = (int32_t) cinfo.image_height;
+
+    cinfo.scale_num   = 1;
+    cinfo.scale_denom = 1;
+    for (unsigned int denom = 8; denom > 1; denom /= 2) {
+        if ((*width + denom - 1) / denom >= (unsigned int) min_width &&
+            (*height + denom - 1) / denom >= (unsigned int) min_height) {
+            cinfo.scale_denom = denom;
+            break;
+        }
+    }
+
+    jpeg_start_decompress(&cinfo);
+    if (frame_alloc(frame,
+                   (int32_t) cinfo.output_width,
+                   (int32_t) cinfo.output_height)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    jpeg_read_rows(&cinfo, frame, cinfo.output_height);
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return 0;
+}
+
+int
+frame_load_jpeg_region(Frame*         frame,
+                       const uint8_t* data,
+                       size_t         size,
+                       const int32_t* roi,
+                       int32_t        origin[2])
+{
+    struct jpeg_decompress_struct cinfo;
+    JpegError                     error;
+
+    frame_empty(frame);
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        frame_empty(frame);
+        return -1;
+    }
+    jpeg_open(&cinfo, &error, data, size);
+
+    int32_t x0 = CLAMP(roi[0], 0, (int32_t) cinfo.image_width);
+    int32_t y0 = CLAMP(roi[1], 0, (int32_t) cinfo.image_height);
+    int32_t x1 = CLAMP(roi[2], 0, (int32_t) cinfo.image_width);
+    int32_t y1 = CLAMP(roi[3], 0, (int32_t) cinfo.image_height);
+    if (x1 <= x0 || y1 <= y0) {
+        jpeg_destroy_decompress(&cinfo);
+        last_error = strerror(EINVAL);
+        return -1;
+    }
+
+    // Columns outside the region skip the IDCT and the rows above it skip
+    // everything but entropy decoding, decoding stops below it.  A column
+    // more on either side keeps the chroma upsampling at the edges of the
+    // region identical to a full decode.
+    jpeg_start_decompress(&cinfo);
+    JDIMENSION x     = (JDIMENSION) MAX(x0 - 1, 0);
+    JDIMENSION width = (JDIMENSION) MIN(x1 + 1, (int32_t) cinfo.image_width) - x;
+    jpeg_crop_scanline(&cinfo, &x, &width);
+    if (y0 > 0) jpeg_skip_scanlines(&cinfo, (JDIMENSION) y0);
+
+    if (frame_alloc(frame, (int32_t) cinfo.output_width, y1 - y0)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    jpeg_read_rows(&cinfo, frame, (JDIMENSION) (y1 - y0));
+    jpeg_destroy_decompress(&cinfo);
+
+    origin[0] = (int32_t) x;
+    origin[1] = y0;
+
+    return 0;
+}
+
+void
+frame_release(Frame* frame)
+{
+    if (frame->heap) free(frame->data);
+    memset(frame, 0, sizeof(*frame));
+}
+
+VAALError
+frame_load_tensor(VAALContext*   ctx,
+                  NNTensor*      tensor,
+                  const Frame*   frame,
+                  const int32_t* roi)
+{
+    if (frame->dmabuf) {
+        return vaal_load_frame_dmabuf(ctx,
+                                      tensor,
+                                      frame->dmabuf,
+                                      frame->fourcc,
+                                      frame->width,
+                                      frame->height,
+                                      roi,
+                                      0);
+    }
+
+    return vaal_load_frame_memory(ctx,
+                                  tensor,
+                                  frame->data,
+                                  frame->fourcc,
+                                  frame->width,
+                                  frame->height,
+                                  roi,
+                                  0);
+}
+
+// Samples averaged along each side of a thumbnail cell.
+#define THUMB_SAMPLES 4
+
+static inline int
+frame_luma(const Frame* frame, int32_t x, int32_t y)
+{
+    const uint8_t* p;
+
+    switch (frame->fourcc) {
+    case FOURCC('R', 'G', 'B', '3'):
+        p = frame->data + ((size_t) y * frame->width + x) * 3;
+        return (p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8;
+    case FOURCC('Y', 'U', 'Y', 'V'):
+        return frame->data[((size_t) y * frame->width + x) * 2];
+    default: // NV12 starts with its full resolution luma plane
+        return frame->data[(size_t) y * frame->width + x];
+    }
+}
+
+// Centre of sample i of the evenly spaced samples between lo and hi.
+static inline int32_t
+thumb_sample(int32_t lo, int32_t hi, int i)
+{
+    const int samples = FRAME_THUMB_DIM * THUMB_SAMPLES;
+    return lo + (int32_t) ((int64_t) (hi - lo) * (2 * i + 1) / (2 * samples));
+}
+
+int
+frame_thumbnail(const Frame*   frame,
+                const int32_t* roi,
+                uint8_t        thumb[FRAME_THUMB_SIZE])
+{
+    if (!frame->data || (frame->fourcc != FOURCC('R', 'G', 'B', '3') &&
+                         frame->fourcc != FOURCC('Y', 'U', 'Y', 'V') &&
+                         frame->fourcc != FOURCC('N', 'V', '1', '2'))) {
+        return -1;
+    }
+
+    int32_t x0 = CLAMP(roi[0], 0, frame->width);
+    int32_t y0 = CLAMP(roi[1], 0, frame->height);
+    int32_t x1 = CLAMP(roi[2], 0, frame->width);
+    int32_t y1 = CLAMP(roi[3], 0, frame->height);
+    if (x1 <= x0 || y1 <= y0) return -1;
+
+    for (int ty = 0; ty < FRAME_THUMB_DIM; ty++) {
+        for (int tx = 0; tx < FRAME_THUMB_DIM; tx++) {
+            int sum = 0;
+            for (int sy = 0; sy < THUMB_SAMPLES; sy++) {
+                int32_t y = thumb_sample(y0, y1, ty * THUMB_SAMPLES + sy);
+                for (int sx = 0; sx < THUMB_SAMPLES; sx++) {
+                    int32_t x = thumb_sample(x0, x1, tx * THUMB_SAMPLES + sx);
+                    sum += frame_luma(frame, x, y);
+                }
+            }
+            thumb[ty * FRAME_THUMB_DIM + tx] =
+                sum / (THUMB_SAMPLES * THUMB_SAMPLES);
+        }
+    }
+
+    return 0;
+}
+
+const char*
+frame_error(void)
+{
+    return last_error ? last_error : "unknown error";
+}
@@ -0,0 +1,170 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vaal.h"
+
+#ifndef FOURCC
+#define FOURCC(a, b, c, d)                                             \
+    ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | \
+     ((uint32_t) (d) << 24))
+#endif
+
+// Side of the grey thumbnail computed by frame_thumbnail().
+#define FRAME_THUMB_DIM 8
+#define FRAME_THUMB_SIZE (FRAME_THUMB_DIM * FRAME_THUMB_DIM)
+
+/**
+ * A decoded image held in memory so it can be fed to several contexts (the
+ * face detector and every head pose crop) without touching the file again.
+ */
+typedef struct {
+    uint8_t* data;     // Packed pixels, RGB3 for decoded image files
+    int32_t  width;    // Width of the frame in pixels
+    int32_t  height;   // Height of the frame in pixels
+    uint32_t fourcc;   // Pixel format of data as understood by VAAL
+    int      dmabuf;   // DMA buffer holding data, 0 when only data is valid
+    bool     heap;     // data comes from malloc() and is owned here
+    size_t   capacity; // Bytes allocated at data when heap
+} Frame;
+
+/**
+ * Decodes the JPEG or PNG image file at path into frame as packed RGB,
+ * straight from a read only mapping of the file, reusing the pixel buffer
+ * of frame when it is large enough.
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_load_file(Frame* frame, const char* path);
+
+/**
+ * Decodes the encoded image file contents held in the size bytes at data
+ * into frame as packed RGB, like frame_load_file().
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_load_memory(Frame* frame, const uint8_t* data, size_t size);
+
+/**
+ * Reads the resolution of the image file at path from its header only,
+ * without decoding any pixels.
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_probe_file(const char* path, int32_t* width, int32_t* height);
+
+/**
+ * Reads the resolution of the encoded image held in the size bytes at data
+ * from its header like frame_probe_file().
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_probe_memory(const uint8_t* data,
+                   size_t         size,
+                   int32_t*       width,
+                   int32_t*       height);
+
+/**
+ * Whether the size bytes at data start with a JPEG marker.
+ */
+bool
+frame_is_jpeg(const uint8_t* data, size_t size);
+
+/**
+ * Decodes the JPEG stream held in the size bytes at data into frame as
+ * packed RGB reduced by the largest of 1/2, 1/4 or 1/8 that keeps it at
+ * least min_width by min_height, at full resolution when none does.  The
+ * reduction happens in the inverse DCT so the discarded resolution is never
+ * computed.  The full resolution of the image is stored in width and height.
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_load_jpeg_scaled(Frame*         frame,
+                       const uint8_t* data,
+                       size_t         size,
+                       int32_t        min_width,
+                       int32_t        min_height,
+                       int32_t*       width,
+                       int32_t*       height);
+
+/**
+ * Decodes only the region roi, xmin, ymin, xmax, ymax in pixels clamped to
+ * the image, of the JPEG stream held in the size bytes at data into frame at
+ * full resolution.  The region is widened to a block boundary on the left
+ * and by a column on the right, the position of its top left corner in the
+ * image is stored in origin.
+ *
+ * Returns 0 on success or -1 on failure, see frame_error() for the cause.
+ */
+int
+frame_load_jpeg_region(Frame*         frame,
+                       const uint8_t* data,
+                       size_t         size,
+                       const int32_t* roi,
+                       int32_t        origin[2]);
+
+/**
+ * Releases the pixels held by frame and resets it to an empty frame.
+ */
+void
+frame_release(Frame* frame);
+
+/**
+ * Loads frame into tensor, or the input tensor of ctx when tensor is NULL,
+ * optionally cropped to roi which is given as xmin, ymin, xmax, ymax in
+ * pixels.  Normalization follows the "normalization" parameter of the context.
+ * Frames backed by a DMA buffer are imported from it without a copy.
+ */
+VAALError
+frame_load_tensor(VAALContext*   ctx,
+                  NNTensor*      tensor,
+                  const Frame*   frame,
+                  const int32_t* roi);
+
+/**
+ * Shrinks the region roi of frame, xmin, ymin, xmax, ymax in pixels and
+ * clamped to the frame, into a FRAME_THUMB_DIM square of luma averaged over a
+ * few samples per cell.  Cheap enough to compare crops between frames.
+ *
+ * Returns 0 on success or -1 if the pixel format is not RGB3, YUYV or NV12
+ * or the region is empty.
+ */
+int
+frame_thumbnail(const Frame*   frame,
+                const int32_t* roi,
+                uint8_t        thumb[FRAME_THUMB_SIZE]);
+
+/**
+ * Describes the last failure of one of the frame_load functions on the calling
+ * thread.
+ */
+const char*
+frame_error(void);
+
+#endif /* FRAME_H */
@@ -0,0 +1,128 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gate.h"
+
+static int64_t
+roi_area(const int32_t* roi)
+{
+    return (int64_t) (roi[2] - roi[0]) * (roi[3] - roi[1]);
+}
+
+// Whether face a ranks before face b.
+static bool
+ranks_before(const FaceGate* gate,
+             const VAALBox*  boxes,
+             int32_t         (*rois)[4],
+             size_t          a,
+             size_t          b)
+{
+    if (gate->by_area) return roi_area(rois[a]) > roi_area(rois[b]);
+    return boxes[a].score > boxes[b].score;
+}
+
+int
+face_gate_init(FaceGate* gate,
+               size_t    max_faces,
+               int32_t   min_face,
+               size_t    top_k,
+               bool      by_area,
+               double    budget_ms)
+{
+    memset(gate, 0, sizeof(*gate));
+    gate->min_face  = min_face;
+    gate->top_k     = top_k;
+    gate->by_area   = by_area;
+    gate->budget_ns = (int64_t) (budget_ms * 1e6);
+    gate->order     = calloc(max_faces, sizeof(size_t));
+    gate->rois      = calloc(max_faces, sizeof(*gate->rois));
+    gate->faces     = calloc(max_faces, sizeof(size_t));
+    gate->results   = calloc(max_faces, sizeof(VAALEuler));
+    gate->times     = calloc(max_faces, sizeof(int64_t));
+
+    if (!gate->order || !gate->rois || !gate->faces || !gate->results ||
+        !gate->times) {
+        face_gate_release(gate);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+face_gate_release(FaceGate* gate)
+{
+    free(gate->order);
+    free(gate->rois);
+    free(gate->faces);
+    free(gate->results);
+    free(gate->times);
+    memset(gate, 0, sizeof(*gate));
+}
+
+size_t
+face_gate_select(FaceGate*      gate,
+                 const VAALBox* boxes,
+                 int32_t        (*rois)[4],
+                 size_t         count,
+                 bool*          skipped)
+{
+    size_t candidates = 0;
+
+    for (size_t j = 0; j < count; j++) {
+        int32_t side = MIN(rois[j][2] - rois[j][0], rois[j][3] - rois[j][1]);
+        skipped[j]   = side < gate->min_face;
+        if (skipped[j]) continue;
+
+        // Insertion keeps the few faces of a frame ranked best first.
+        size_t k = candidates++;
+        while (k > 0 &&
+               ranks_before(gate, boxes, rois, j, gate->order[k - 1])) {
+            gate->order[k] = gate->order[k - 1];
+            k--;
+        }
+        gate->order[k] = j;
+    }
+
+    size_t limit = gate->top_k ? gate->top_k : candidates;
+    if (gate->budget_ns > 0 && gate->face_ns > 0) {
+        size_t fit = (size_t) (gate->budget_ns / gate->face_ns);
+        limit      = MIN(limit, MAX(fit, 1));
+    }
+    for (size_t k = limit; k < candidates; k++) skipped[gate->order[k]] = true;
+
+    return count - MIN(candidates, limit);
+}
+
+void
+face_gate_update(FaceGate* gate, const PoseTiming* timing, size_t faces)
+{
+    if (!faces) return;
+
+    double per_face =
+        (double) (timing->load_ns + timing->inference_ns + timing->euler_ns) /
+        faces;
+    if (gate->face_ns > 0) {
+        gate->face_ns += FACE_GATE_EWMA_ALPHA * (per_face - gate->face_ns);
+    } else {
+        gate->face_ns = per_face;
+    }
+}
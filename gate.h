@@ -0,0 +1,92 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef GATE_H
+#define GATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pose.h"
+#include "vaal.h"
+
+// Weight of the latest frame in the smoothed head pose time per face.
+#define FACE_GATE_EWMA_ALPHA 0.2
+
+/**
+ * Decides which detected faces are worth a head pose inference: faces whose
+ * crop is smaller than min_face pixels on either side are skipped, and of
+ * the rest at most top_k, ranked by score or by crop area, and as many as
+ * fit in budget_ns at the time a face took on previous frames.  At least one
+ * face is always kept when any passes the size gate.
+ */
+typedef struct {
+    int32_t    min_face;   // Smallest crop side in pixels, 0 for any
+    size_t     top_k;      // Most faces per frame, 0 for all
+    bool       by_area;    // Rank faces by crop area instead of score
+    int64_t    budget_ns;  // Head pose time per frame, 0 for unlimited
+    double     face_ns;    // Smoothed head pose time per face, 0 until known
+    size_t*    order;      // Faces passing the size gate, best first
+    int32_t    (*rois)[4]; // Crops of the kept faces
+    size_t*    faces;      // Face of the job behind each of rois
+    VAALEuler* results;    // Orientations estimated for rois
+    int64_t*   times;      // Timing of each of rois
+} FaceGate;
+
+/**
+ * Prepares gate for up to max_faces faces per frame, budget_ms of 0 leaving
+ * the time per frame unlimited.
+ *
+ * Returns 0 on success or -1 when out of memory.
+ */
+int
+face_gate_init(FaceGate* gate,
+               size_t    max_faces,
+               int32_t   min_face,
+               size_t    top_k,
+               bool      by_area,
+               double    budget_ms);
+
+/**
+ * Releases the arrays held by gate.
+ */
+void
+face_gate_release(FaceGate* gate);
+
+/**
+ * Sets skipped for each of the count faces given by boxes and their crops
+ * rois, in pixels, which the gate turns down.
+ *
+ * Returns the number of faces skipped.
+ */
+size_t
+face_gate_select(FaceGate*      gate,
+                 const VAALBox* boxes,
+                 int32_t        (*rois)[4],
+                 size_t         count,
+                 bool*          skipped);
+
+/**
+ * Folds the time timing took for faces head pose inferences into the time
+ * per face the budget is shared by.
+ */
+void
+face_gate_update(FaceGate* gate, const PoseTiming* timing, size_t faces);
+
+#endif /* GATE_H */
@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -25,10 +26,25 @@
 #include <strings.h>
 #endif
 
+#include "bench.h"
+#include "camera.h"
+#include "frame.h"
+#include "input.h"
+#include "output.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "pose.h"
+#include "preprocess.h"
+#include "server.h"
+#include "shmring.h"
+#include "stages.h"
+#include "stats.h"
+#include "trace.h"
 #include "vaal.h"
 
 #define USAGE \
     "detect [hv] model.rtm image0 [imageN]\n\
+    An image of - reads further image paths from stdin, one per line.\n\
     -h, --help\n\
         Display help information\n\
     -v, --version\n\
@@ -51,21 +67,264 @@
     -d, --no_detect \n\
         Whether to use face detection on each image before determining \n\
         face orientation \n\
+    -s, --shared_frame \n\
+        Decode each image once into memory and feed both the face detector \n\
+        and every head pose crop from that frame instead of reloading the \n\
+        file for each face \n\
+    -j, --pipeline N \n\
+        Overlap decoding, face detection and head pose by running N decoder \n\
+        threads feeding a detection thread and a head pose thread. Results \n\
+        are printed in input order and frames are always shared. \n\
+    -w, --workers N \n\
+        Create N independent face detection and head pose context pairs, \n\
+        each driven by its own worker thread, and spread the images across \n\
+        them with work stealing. Intended for the cpu engine, takes \n\
+        precedence over --pipeline. \n\
+    -a, --affinity CPUS \n\
+        Pin worker threads to the given CPUs, a list such as 0-3 or 0,2,4,6. \n\
+        Worker i runs on the i-th CPU of the list, wrapping around. \n\
+    -i, --input_dir DIR \n\
+        Process every image file found while walking DIR and its \n\
+        subdirectories instead of images given on the command line \n\
+    -g, --glob PATTERN \n\
+        Only process files of --input_dir whose name matches PATTERN, \n\
+        for example \"*.png\" \n\
+    -l, --input_list FILE \n\
+        Process the image paths listed one per line in FILE, - for stdin \n\
+    -b, --benchmark \n\
+        Decode each image once, keep it in memory and time repeated runs \n\
+        of face detection and head pose on it instead of printing results \n\
+    --warmup N \n\
+        Untimed benchmark iterations per image, by default 3 \n\
+    --repeat N \n\
+        Timed benchmark iterations per image, by default 10 \n\
+    --bench_probe \n\
+        Also time reading the resolution of every image through VAAL and \n\
+        from its header, --repeat times each \n\
+    --report FILE \n\
+        Write the benchmark latency distributions and throughput to FILE \n\
+        as JSON, or as CSV when FILE ends in .csv \n\
+    -o, --output FILE \n\
+        Write results to FILE instead of stdout \n\
+    --output_format FORMAT \n\
+        Format of the results, human readable logging is disabled for all \n\
+        but text \n\
+            - text (default) \n\
+            - csv (one row per face: file, face, box, score, yaw, pitch, \n\
+              roll) \n\
+            - jsonl (one JSON object per image with its faces) \n\
+            - bin (fixed size records, see output.h) \n\
+    --serve SOCKET \n\
+        Keep the models loaded and answer requests on the Unix socket \n\
+        SOCKET until interrupted instead of processing images, see \n\
+        server.h for the protocol \n\
+    --camera DEVICE \n\
+        Track head pose on the live feed of the V4L2 DEVICE, such as \n\
+        /dev/video0, until interrupted. Only the newest frame is processed, \n\
+        frames arriving meanwhile are dropped and counted. \n\
+    --camera_size WIDTHxHEIGHT \n\
+        Resolution requested from the camera, by default 640x480 \n\
+    --frames N \n\
+        Stop after processing N camera frames \n\
+    --detect_interval K \n\
+        Track faces across consecutive images or camera frames, giving each \n\
+        a stable identifier, and only run face detection every K frames or \n\
+        when faces appear, vanish or stray from their predicted boxes. Head \n\
+        pose runs on the predicted boxes in between. Cannot be combined \n\
+        with --workers. \n\
+    --pose_cache THRESHOLD \n\
+        With --detect_interval, reuse the head pose of a tracked face while \n\
+        its crop stays unchanged: the mean difference of its 8x8 grey \n\
+        thumbnail, from 0 to 255, is at most THRESHOLD \n\
+    --pose_cache_ttl N \n\
+        Estimate cached head poses again after N frames, by default 30 \n\
+    --preprocess KERNEL \n\
+        How head pose crops are cropped, resized and normalized, implies \n\
+        --shared_frame \n\
+            - vaal (default, VAAL loads every crop) \n\
+            - auto (fastest kernel below supported by this CPU) \n\
+            - avx2, sse2, neon or scalar \n\
+    --jpeg_scaled \n\
+        Decode JPEG images at 1/2, 1/4 or 1/8 of their size when that \n\
+        still covers the face detector input, and only the region around \n\
+        the faces at full size for head pose. Implies --shared_frame \n\
+    --pose_engines LIST \n\
+        Comma separated compute engines of more head pose contexts, such \n\
+        as cpu,cpu, sharing the faces of every image with the main engine \n\
+        in proportion to their measured time per face \n\
+    --pose_async \n\
+        Run the head pose model on a thread of its own and load the crops \n\
+        of the next faces while it runs, with --preprocess \n\
+    --min_face PIXELS \n\
+        Skip the head pose of faces whose crop is narrower or shorter \n\
+    --top_k N \n\
+        Estimate the head pose of at most N faces per image, those with \n\
+        the highest score \n\
+    --top_k_area \n\
+        Rank the faces for --top_k by crop area instead of score \n\
+    --pose_budget MS \n\
+        Estimate only as many faces per image as fit in MS milliseconds \n\
+        of head pose at the time per face measured so far, at least one. \n\
+        Skipped faces are still reported, marked as skipped \n\
+    --roi_pad FRACTION \n\
+        Pad every face crop by FRACTION of its box on each side \n\
+    --roi_square \n\
+        Expand face crops to squares. Padded or square crops are shifted \n\
+        inside the image and their width rounded to a multiple of 4 \n\
+    --cache_dir DIR \n\
+        Keep the graphs the NPU driver compiles for the models in DIR, \n\
+        created when missing, so later runs skip compiling them \n\
+    --shm NAME \n\
+        Also publish the results of every image to the POSIX shared memory \n\
+        ring NAME, see shmring.h for the layout \n\
+    --shm_frames WIDTHxHEIGHT \n\
+        With --shm, carry decoded frames of up to WIDTHxHEIGHT pixels in \n\
+        the ring alongside their results, implies --shared_frame \n\
+    --trace FILE \n\
+        Record spans of every decode, detector and head pose step and \n\
+        output on every thread, written to FILE at exit as Chrome trace \n\
+        JSON for chrome://tracing or ui.perfetto.dev \n\
+    --detect_models LIST \n\
+        Comma separated face detection models, each cheaper than the one \n\
+        before and than the one found through VAAL_MODEL_PATH, to fall \n\
+        back to when frames exceed --latency_budget. Implies \n\
+        --shared_frame \n\
+    --latency_budget MS \n\
+        With --detect_models, step to the next cheaper detector while the \n\
+        smoothed frame latency exceeds MS milliseconds and back once the \n\
+        more accurate one is predicted to fit comfortably again \n\
 "
 
+// Options without a short form
+enum {
+    OPT_WARMUP = 256,
+    OPT_REPEAT,
+    OPT_BENCH_PROBE,
+    OPT_REPORT,
+    OPT_OUTPUT_FORMAT,
+    OPT_SERVE,
+    OPT_CAMERA,
+    OPT_CAMERA_SIZE,
+    OPT_FRAMES,
+    OPT_DETECT_INTERVAL,
+    OPT_POSE_CACHE,
+    OPT_POSE_CACHE_TTL,
+    OPT_PREPROCESS,
+    OPT_JPEG_SCALED,
+    OPT_POSE_ENGINES,
+    OPT_POSE_ASYNC,
+    OPT_MIN_FACE,
+    OPT_TOP_K,
+    OPT_TOP_K_AREA,
+    OPT_POSE_BUDGET,
+    OPT_ROI_PAD,
+    OPT_ROI_SQUARE,
+    OPT_CACHE_DIR,
+    OPT_SHM,
+    OPT_SHM_FRAMES,
+    OPT_TRACE,
+    OPT_DETECT_MODELS,
+    OPT_LATENCY_BUDGET,
+};
+
+// Where completed jobs are reported, passed to the stages as user data.
+typedef struct {
+    Output*  output;
+    Stats*   stats;
+    ShmRing* ring;        // Shared memory results or NULL
+    bool     face_detect; // Face detection was requested
+    bool     verbose;     // Human readable logging on stdout
+} Reporter;
+
+// Tells whether the face detection model requested was found.
+static void
+report_detector(const Stages* stages, bool face_detect, bool verbose)
+{
+    if (!face_detect) return;
+    if (stages->faces_ctx) {
+        if (verbose) {
+            printf("Found face detection model, running two step pipeline.\n");
+        }
+    } else {
+        fprintf(verbose ? stdout : stderr,
+                "Unable to locate face detection model, please ensure VAAL_MODEL_PATH has been set.\n");
+    }
+}
+
+// Reports the detector of the contexts pinned pool workers created.
+static void
+pool_ready(const Stages* stages, void* user)
+{
+    const Reporter* reporter = user;
+    report_detector(stages, reporter->face_detect, reporter->verbose);
+    // Results bypass stdio, the banner has to come out ahead of them.
+    fflush(stdout);
+}
+
+// Reports a completed job and records its timings, called in input order.
+static void
+output_report(const Job* job, void* user)
+{
+    Reporter* reporter = user;
+    int64_t   start    = vaal_clock_now();
+
+    output_job(reporter->output, job);
+    if (reporter->ring) shm_ring_publish(reporter->ring, job);
+    stats_add_job(reporter->stats, job, vaal_clock_now() - start);
+}
+
 int
 main(int argc, char* argv[])
 {
     // These can be modified as needed
-    int         err;
-    int         max_detection = 25; // Max number of boxes to be found
-    float       score_thr     = 0.5f; // The score threshold that a box must exceed to be reported
-    float       iou_thr       = 0.5f; // The IoU threshold to consider if boxes overlap
-    const char* engine        = "npu";
-    const char* model         = NULL;
-    int         norm          = 0;
-    int         max_label     = 16;
-    bool        face_detect   = true;
+    int          max_detection   = 25; // Max number of boxes to be found
+    float        score_thr       = 0.5f; // The score threshold that a box must exceed to be reported
+    float        iou_thr         = 0.5f; // The IoU threshold to consider if boxes overlap
+    const char*  engine          = "npu";
+    const char*  model           = NULL;
+    int          norm            = 0;
+    int          max_label       = 16;
+    bool         face_detect     = true;
+    bool         shared_frame    = false;
+    int          decoders        = 0;
+    int          workers         = 1;
+    int          cpus[POOL_MAX_CPUS];
+    int          num_cpus        = 0;
+    const char*  input_dir       = NULL;
+    const char*  input_glob      = NULL;
+    const char*  input_list      = NULL;
+    bool         benchmark       = false;
+    int          warmup          = 3;
+    int          repeat          = 10;
+    bool         bench_probe     = false;
+    const char*  report          = NULL;
+    const char*  output_path     = NULL;
+    OutputFormat output_format   = OUTPUT_TEXT;
+    const char*  serve           = NULL;
+    const char*  camera_device   = NULL;
+    int32_t      camera_width    = 640;
+    int32_t      camera_height   = 480;
+    uint64_t     frames          = 0;
+    int          detect_interval = 0;
+    int          pose_cache_thr  = -1;
+    int          pose_cache_ttl  = 30;
+    int          preprocess      = PREPROCESS_VAAL;
+    bool         jpeg_scaled     = false;
+    const char*  pose_engines    = NULL;
+    bool         pose_async      = false;
+    int32_t      min_face        = 0;
+    int          top_k           = 0;
+    bool         top_k_area      = false;
+    double       pose_budget     = 0;
+    float        roi_pad         = 0.0f;
+    bool         roi_square      = false;
+    const char*  cache_dir       = NULL;
+    const char*  shm             = NULL;
+    int32_t      shm_width       = 0;
+    int32_t      shm_height      = 0;
+    const char*  trace           = NULL;
+    const char*  detect_models   = NULL;
+    double       latency_budget  = 0;
 
     static struct option options[] = {
         {"help", no_argument, NULL, 'h'},
@@ -76,12 +335,50 @@ main(int argc, char* argv[])
         {"iou", required_argument, NULL, 'u'},
         {"norm", required_argument, NULL, 'n'},
         {"engine", required_argument, NULL, 'e'},
+        {"shared_frame", no_argument, NULL, 's'},
+        {"pipeline", required_argument, NULL, 'j'},
+        {"workers", required_argument, NULL, 'w'},
+        {"affinity", required_argument, NULL, 'a'},
+        {"input_dir", required_argument, NULL, 'i'},
+        {"glob", required_argument, NULL, 'g'},
+        {"input_list", required_argument, NULL, 'l'},
+        {"benchmark", no_argument, NULL, 'b'},
+        {"warmup", required_argument, NULL, OPT_WARMUP},
+        {"repeat", required_argument, NULL, OPT_REPEAT},
+        {"bench_probe", no_argument, NULL, OPT_BENCH_PROBE},
+        {"report", required_argument, NULL, OPT_REPORT},
+        {"output", required_argument, NULL, 'o'},
+        {"output_format", required_argument, NULL, OPT_OUTPUT_FORMAT},
+        {"serve", required_argument, NULL, OPT_SERVE},
+        {"camera", required_argument, NULL, OPT_CAMERA},
+        {"camera_size", required_argument, NULL, OPT_CAMERA_SIZE},
+        {"frames", required_argument, NULL, OPT_FRAMES},
+        {"detect_interval", required_argument, NULL, OPT_DETECT_INTERVAL},
+        {"pose_cache", required_argument, NULL, OPT_POSE_CACHE},
+        {"pose_cache_ttl", required_argument, NULL, OPT_POSE_CACHE_TTL},
+        {"preprocess", required_argument, NULL, OPT_PREPROCESS},
+        {"jpeg_scaled", no_argument, NULL, OPT_JPEG_SCALED},
+        {"pose_engines", required_argument, NULL, OPT_POSE_ENGINES},
+        {"pose_async", no_argument, NULL, OPT_POSE_ASYNC},
+        {"min_face", required_argument, NULL, OPT_MIN_FACE},
+        {"top_k", required_argument, NULL, OPT_TOP_K},
+        {"top_k_area", no_argument, NULL, OPT_TOP_K_AREA},
+        {"pose_budget", required_argument, NULL, OPT_POSE_BUDGET},
+        {"roi_pad", required_argument, NULL, OPT_ROI_PAD},
+        {"roi_square", no_argument, NULL, OPT_ROI_SQUARE},
+        {"cache_dir", required_argument, NULL, OPT_CACHE_DIR},
+        {"shm", required_argument, NULL, OPT_SHM},
+        {"shm_frames", required_argument, NULL, OPT_SHM_FRAMES},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"detect_models", required_argument, NULL, OPT_DETECT_MODELS},
+        {"latency_budget", required_argument, NULL, OPT_LATENCY_BUDGET},
+        {NULL, 0, NULL, 0},
     };
 
     // Processing of command line arguments
     for (;;) {
         int opt =
-            getopt_long(argc, argv, "hvdm:t:u:n:e:", options, NULL);
+            getopt_long(argc, argv, "hvdsbm:t:u:n:e:j:w:a:i:g:l:o:", options, NULL);
         if (opt == -1) break;
 
         switch (opt) {
@@ -125,6 +422,144 @@ main(int argc, char* argv[])
         case 'd':
             face_detect = false;
             break;
+        case 's':
+            shared_frame = true;
+            break;
+        case 'j':
+            decoders = MAX(atoi(optarg), 1);
+            break;
+        case 'w':
+            workers = MAX(atoi(optarg), 1);
+            break;
+        case 'a':
+            num_cpus = pool_parse_cpus(optarg, cpus, POOL_MAX_CPUS);
+            if (num_cpus < 0) {
+                fprintf(stderr, "invalid cpu list: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'i':
+            input_dir = optarg;
+            break;
+        case 'g':
+            input_glob = optarg;
+            break;
+        case 'l':
+            input_list = optarg;
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case OPT_WARMUP:
+            warmup = MAX(atoi(optarg), 0);
+            break;
+        case OPT_REPEAT:
+            repeat = MAX(atoi(optarg), 1);
+            break;
+        case OPT_BENCH_PROBE:
+            bench_probe = true;
+            break;
+        case OPT_REPORT:
+            report = optarg;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case OPT_OUTPUT_FORMAT:
+            if (output_parse_format(optarg, &output_format)) {
+                fprintf(stderr, "unsupported output format: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SERVE:
+            serve = optarg;
+            break;
+        case OPT_CAMERA:
+            camera_device = optarg;
+            break;
+        case OPT_CAMERA_SIZE:
+            if (sscanf(optarg, "%dx%d", &camera_width, &camera_height) != 2 ||
+                camera_width <= 0 || camera_height <= 0) {
+                fprintf(stderr, "invalid camera size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_FRAMES:
+            frames = strtoull(optarg, NULL, 10);
+            break;
+        case OPT_DETECT_INTERVAL:
+            detect_interval = MAX(atoi(optarg), 1);
+            break;
+        case OPT_POSE_CACHE:
+            pose_cache_thr = CLAMP(atoi(optarg), 0, 255);
+            break;
+        case OPT_POSE_CACHE_TTL:
+            pose_cache_ttl = MAX(atoi(optarg), 1);
+            break;
+        case OPT_PREPROCESS: {
+            PreprocessKernel kernel;
+            if (preprocess_parse(optarg, &kernel)) {
+                fprintf(stderr, "unsupported preprocess kernel: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            preprocess = preprocess_select(kernel);
+            if (preprocess < 0) {
+                fprintf(stderr,
+                        "preprocess kernel %s is not supported by this CPU\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case OPT_JPEG_SCALED:
+            jpeg_scaled = true;
+            break;
+        case OPT_POSE_ENGINES:
+            pose_engines = optarg;
+            break;
+        case OPT_POSE_ASYNC:
+            pose_async = true;
+            break;
+        case OPT_MIN_FACE:
+            min_face = atoi(optarg);
+            break;
+        case OPT_TOP_K:
+            top_k = atoi(optarg);
+            break;
+        case OPT_TOP_K_AREA:
+            top_k_area = true;
+            break;
+        case OPT_POSE_BUDGET:
+            pose_budget = atof(optarg);
+            break;
+        case OPT_ROI_PAD:
+            roi_pad = CLAMP(atof(optarg), 0.0f, 1.0f);
+            break;
+        case OPT_ROI_SQUARE:
+            roi_square = true;
+            break;
+        case OPT_CACHE_DIR:
+            cache_dir = optarg;
+            break;
+        case OPT_SHM:
+            shm = optarg;
+            break;
+        case OPT_SHM_FRAMES:
+            if (sscanf(optarg, "%dx%d", &shm_width, &shm_height) != 2 ||
+                shm_width <= 0 || shm_height <= 0) {
+                fprintf(stderr, "invalid shared frame size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TRACE:
+            trace = optarg;
+            break;
+        case OPT_DETECT_MODELS:
+            detect_models = optarg;
+            break;
+        case OPT_LATENCY_BUDGET:
+            latency_budget = atof(optarg);
+            break;
         default:
             fprintf(stderr,
                     "invalid parameter %c, try --help for usage\n",
@@ -140,147 +575,226 @@ main(int argc, char* argv[])
 
     model = argv[optind++];
 
-    // Initialize boxes object and context with requested engine
-    size_t     num_boxes        = 0;
-    size_t     num_orientations = 0;
-    VAALBox*   boxes            = calloc(max_detection, sizeof(VAALBox));
-    VAALEuler* orientations     = calloc(1, sizeof(VAALEuler));
-    int32_t*   roi              = calloc(4, sizeof(int32_t));
-
-    VAALContext *pose_ctx = vaal_context_create(engine);
-    err = vaal_load_model_file(pose_ctx, model);
-    if (err) {
-        fprintf(stderr, "failed to load model: %s\n", vaal_strerror(err));
+    if (detect_interval && workers > 1) {
+        fprintf(stderr, "--detect_interval needs images in order, "
+                        "it cannot be combined with --workers\n");
+        return EXIT_FAILURE;
+    } else if (pose_cache_thr >= 0 && !detect_interval) {
+        fprintf(stderr, "--pose_cache needs --detect_interval\n");
+        return EXIT_FAILURE;
+    } else if (detect_models && latency_budget <= 0) {
+        fprintf(stderr, "--detect_models needs --latency_budget\n");
+        return EXIT_FAILURE;
+    } else if (latency_budget > 0 && !detect_models) {
+        fprintf(stderr, "--latency_budget needs --detect_models\n");
         return EXIT_FAILURE;
     }
-    vaal_parameter_seti(pose_ctx, "normalization", &norm, 1);
 
-    VAALContext *faces_ctx = NULL;
-    if (face_detect) {
-        faces_ctx = vaal_model_probe(engine, model_type_face_detection);
-        if (faces_ctx) {
-            printf("Found face detection model, running two step pipeline.\n");
-            int faces_norm = 0;
-            // Set NMS parameters for context, values can be changed at start of main
-            vaal_parameter_seti(faces_ctx, "max_detection", &max_detection, 1);
-            vaal_parameter_setf(faces_ctx, "score_threshold", &score_thr, 1);
-            vaal_parameter_setf(faces_ctx, "iou_threshold", &iou_thr, 1);
-            vaal_parameter_seti(faces_ctx, "normalization", &faces_norm, 1);
-        } else {
-            printf("Unable to locate face detection model, please ensure VAAL_MODEL_PATH has been set.\n");
-            face_detect = false;
-        }
+    Input input;
+    if (input_dir && input_list) {
+        fprintf(stderr, "--input_dir and --input_list are exclusive\n");
+        return EXIT_FAILURE;
+    } else if (serve && (input_dir || input_list || optind < argc)) {
+        fprintf(stderr, "images cannot be combined with --serve\n");
+        return EXIT_FAILURE;
+    } else if (camera_device &&
+               (input_dir || input_list || optind < argc || serve ||
+                benchmark)) {
+        fprintf(stderr,
+                "--camera cannot be combined with images, --serve or "
+                "--benchmark\n");
+        return EXIT_FAILURE;
+    } else if ((input_dir || input_list) && optind < argc) {
+        fprintf(stderr,
+                "images cannot be combined with --input_dir or --input_list\n");
+        return EXIT_FAILURE;
+    } else if (input_dir) {
+        if (input_open_dir(&input, input_dir, input_glob)) return EXIT_FAILURE;
+    } else if (input_list) {
+        if (input_open_list(&input, input_list)) return EXIT_FAILURE;
+    } else {
+        input_open_args(&input, &argv[optind], argc - optind);
     }
 
-    // Loop through all provided images
-    for (int i = optind; i < argc; i++) {
-        int64_t     start, load_ns, inference_ns, boxes_ns, pose_ns;
-        const char* image = argv[i];
-
-        // Load image into context
-        if (face_detect) {
-            printf("  [box] (scr%%): xmin ymin xmax ymax   yaw    pitch   roll\r\n");
-            int32_t w, h = 0;
-            err = vaal_image_file_resolution(image, &w, &h);
-            printf("Width: %d Height: %d\n", w, h);
-            err = vaal_load_image_file(faces_ctx, NULL, image, NULL, 0);
-            if (err) {
-                fprintf(stderr,
-                        "failed to load %s: %s\n",
-                        image,
-                        vaal_strerror(err));
-                return EXIT_FAILURE;
-            }
-            
-            err = vaal_run_model(faces_ctx);
-            err = vaal_boxes(faces_ctx, boxes, max_detection, &num_boxes);
-            for (size_t j = 0; j < num_boxes; j++) {
-                char           label_index[12];
-                const VAALBox* box = &boxes[j];
-                roi[0] = (int32_t) (box->xmin * (float)w);
-                roi[1] = (int32_t) (box->ymin * (float)h);
-                roi[2] = (int32_t) (box->xmax * (float)w);
-                roi[3] = (int32_t) (box->ymax * (float)h);
-                start = vaal_clock_now();
-                err   = vaal_load_image_file(pose_ctx, NULL, image, roi, 0);
-                if (err) {
-                    fprintf(stderr,
-                            "failed to load %s: %s\n",
-                            image,
-                            vaal_strerror(err));
-                    return EXIT_FAILURE;
-                }
-                load_ns = vaal_clock_now() - start;
-
-                start        = vaal_clock_now();
-                err          = vaal_run_model(pose_ctx);
-                inference_ns = vaal_clock_now() - start;
-                if (err) {
-                    fprintf(stderr, "failed to run model: %s\n", vaal_strerror(err));
-                    return EXIT_FAILURE;
-                }
-
-                if (vaal_euler(pose_ctx, orientations, &num_orientations)) {
-                    fprintf(stderr, "Head pose decode failed.\n");
-                    return 1;
-                }
-
-                printf("  [%3zu] (%3d%%): %3.2f %3.2f %3.2f %3.2f %+3.4f %+3.4f %+3.4f\r\n",
-                       j,
-                       (int) (box->score * 100),
-                       box->xmin,
-                       box->ymin,
-                       box->xmax,
-                       box->ymax,
-                       orientations[0].yaw,
-                       orientations[0].pitch,
-                       orientations[0].roll);
-            }
-        } else {
-            start = vaal_clock_now();
-            err   = vaal_load_image_file(pose_ctx, NULL, image, NULL, 0);
-            if (err) {
-                fprintf(stderr,
-                        "failed to load %s: %s\n",
-                        image,
-                        vaal_strerror(err));
-                return EXIT_FAILURE;
-            }
-            load_ns = vaal_clock_now() - start;
+    StagesConfig config = {
+        .engine          = engine,
+        .model           = model,
+        .norm            = norm,
+        .face_detect     = face_detect,
+        // Crops are compared and preprocessed on the decoded frame.
+        .shared_frame    = shared_frame || pose_cache_thr >= 0 ||
+                        preprocess != PREPROCESS_VAAL || jpeg_scaled ||
+                        (shm && shm_width) || detect_models,
+        .max_detection   = max_detection,
+        .score_thr       = score_thr,
+        .iou_thr         = iou_thr,
+        .detect_interval = detect_interval,
+        .pose_cache      = pose_cache_thr >= 0,
+        .pose_cache_thr  = pose_cache_thr,
+        .pose_cache_ttl  = pose_cache_ttl,
+        .preprocess      = preprocess,
+        .jpeg_scaled     = jpeg_scaled,
+        .pose_engines    = pose_engines,
+        .pose_async      = pose_async,
+        .min_face        = min_face,
+        .top_k           = top_k,
+        .top_k_area      = top_k_area,
+        .pose_budget     = pose_budget,
+        .roi_pad         = roi_pad,
+        .roi_square      = roi_square,
+        .detect_models   = detect_models,
+        .latency_budget  = latency_budget,
+    };
 
-            start        = vaal_clock_now();
-            err          = vaal_run_model(pose_ctx);
-            inference_ns = vaal_clock_now() - start;
-            if (err) {
-                fprintf(stderr, "failed to run model: %s\n", vaal_strerror(err));
-                return EXIT_FAILURE;
+    // The NPU driver reads its graph cache settings when loading a model.
+    if (cache_dir && stages_graph_cache(cache_dir)) return EXIT_FAILURE;
+    if (trace && trace_open(trace)) return EXIT_FAILURE;
+
+    // Human readable logging stays out of structured results, warnings
+    // still go to stderr.
+    bool verbose = output_format == OUTPUT_TEXT;
+
+    // Pinned pool workers all create their contexts on their own CPU, those
+    // of worker 0 coming back in stages, so none are created here.
+    bool   pinned = !camera_device && !serve && !benchmark && workers > 1 &&
+                  num_cpus;
+    Stages stages = {0};
+    if (!pinned) {
+        // Initialize contexts with requested engine
+        if (stages_open(&stages, &config)) return EXIT_FAILURE;
+        report_detector(&stages, face_detect, verbose);
+        if (!stages.faces_ctx) config.face_detect = false;
+    }
+
+    Stats stats;
+    stats_init(&stats);
+
+    // Benchmarks and the server report their results themselves.
+    bool   results = !benchmark && !serve;
+    Output output;
+    if (results && output_open(&output, output_format, output_path)) {
+        stages_close(&stages);
+        input_close(&input);
+        return EXIT_FAILURE;
+    }
+
+    // Frames are stored as decoded, at most three bytes per pixel.
+    ShmRing ring;
+    if (results && shm &&
+        shm_ring_create(&ring,
+                        shm,
+                        max_detection,
+                        (size_t) shm_width * shm_height * 3)) {
+        output_close(&output);
+        stages_close(&stages);
+        input_close(&input);
+        return EXIT_FAILURE;
+    }
+
+    Reporter reporter = {
+        .output      = &output,
+        .stats       = &stats,
+        .ring        = results && shm ? &ring : NULL,
+        .face_detect = face_detect,
+        .verbose     = verbose,
+    };
+
+    int status = EXIT_SUCCESS;
+    if (camera_device) {
+        Camera camera;
+        if (camera_open(&camera,
+                        camera_device,
+                        camera_width,
+                        camera_height,
+                        FOURCC('Y', 'U', 'Y', 'V'))) {
+            status = EXIT_FAILURE;
+        } else {
+            if (camera_run(&stages,
+                           &camera,
+                           frames,
+                           output_report,
+                           &reporter)) {
+                status = EXIT_FAILURE;
             }
+            camera_close(&camera);
+            fprintf(verbose ? stdout : stderr,
+                    "Camera: %" PRIu64 " frames captured %" PRIu64
+                    " dropped\n",
+                    camera.captured,
+                    camera.dropped);
+        }
+    } else if (serve) {
+        if (verbose) {
+            printf("Serving on %s\n", serve);
+            fflush(stdout);
+        }
+        if (server_run(&stages, serve, &stats)) status = EXIT_FAILURE;
+    } else if (benchmark) {
+        BenchConfig bench = {
+            .warmup = warmup,
+            .repeat = repeat,
+            .report = report,
+            .engine = engine,
+            .model  = model,
+            .probe  = bench_probe,
+        };
+        if (bench_run(&stages, &bench, &input)) status = EXIT_FAILURE;
+    } else if (workers > 1) {
+        if (pool_run(&stages,
+                     &config,
+                     workers,
+                     num_cpus ? cpus : NULL,
+                     num_cpus,
+                     &input,
+                     pinned ? pool_ready : NULL,
+                     output_report,
+                     &reporter)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (decoders > 0) {
+        if (pipeline_run(&stages,
+                         decoders,
+                         &input,
+                         output_report,
+                         &reporter)) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        Job job;
+        if (job_init(&job, max_detection)) {
+            fprintf(stderr, "failed to allocate job: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
 
-            start = vaal_clock_now();
-            if (vaal_euler(pose_ctx, orientations, &num_orientations)) {
-                fprintf(stderr, "Head pose decode failed.\n");
-                return 1;
+        // Loop through all provided images
+        const char* image;
+        while ((image = input_next(&input))) {
+            snprintf(job.path, sizeof(job.path), "%s", image);
+            if (stage_decode(&stages, &job) || stage_detect(&stages, &job) ||
+                stage_pose(&stages, &job)) {
+                status = EXIT_FAILURE;
+                break;
             }
-            pose_ns = vaal_clock_now() - start;
-
-            printf("Load: %.4f Infer: %.4f Decode: %.4f \n"
-                   "Yaw: %.4f Pitch %.4f Roll %.4f\n",
-                    load_ns / 1e6,
-                    inference_ns / 1e6,
-                    pose_ns / 1e6,
-                    orientations[0].yaw,
-                    orientations[0].pitch,
-                    orientations[0].roll);
+            output_report(&job, &reporter);
         }
+
+        if (input.error) status = EXIT_FAILURE;
+        job_release(&job);
+    }
+
+    if (results && output_close(&output)) status = EXIT_FAILURE;
+    if (reporter.ring) shm_ring_close(reporter.ring);
+    if (trace_close()) status = EXIT_FAILURE;
+    if (!benchmark && verbose && stats.images) stats_print(&stats, stdout);
+    if (verbose && stages.scheduler) {
+        pose_scheduler_print(stages.scheduler, stdout);
     }
+    if (verbose && stages.adapt) adapt_print(stages.adapt, stdout);
+    if (verbose && stages.pose) stages_print_startup(&stages, stdout);
 
-    // Free memory used for context and boxes
-    if (face_detect)
-        vaal_context_release(faces_ctx);
-    vaal_context_release(pose_ctx);
-    free(boxes);
-    free(orientations);
-    free(roi);
+    // Free memory used for contexts
+    stages_close(&stages);
+    input_close(&input);
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -0,0 +1,294 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "input.h"
+#include "mapfile.h"
+
+void
+input_open_args(Input* input, char** args, int count)
+{
+    memset(input, 0, sizeof(*input));
+    input->args     = args;
+    input->num_args = count;
+}
+
+static int
+open_list(Input* input, const char* path)
+{
+    if (strcmp(path, "-") == 0) {
+        input->list      = stdin;
+        input->owns_list = false;
+        return 0;
+    }
+
+    input->list = fopen(path, "r");
+    if (!input->list) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    input->owns_list = true;
+
+    return 0;
+}
+
+int
+input_open_list(Input* input, const char* path)
+{
+    memset(input, 0, sizeof(*input));
+    return open_list(input, path);
+}
+
+int
+input_open_dir(Input* input, const char* dir, const char* pattern)
+{
+    memset(input, 0, sizeof(*input));
+    input->pattern = pattern;
+
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') len--;
+    if (len >= sizeof(input->path)) {
+        fprintf(stderr,
+                "failed to open %s: %s\n",
+                dir,
+                strerror(ENAMETOOLONG));
+        return -1;
+    }
+    memcpy(input->path, dir, len);
+    input->path[len] = '\0';
+
+    input->dirs[0] = opendir(input->path);
+    if (!input->dirs[0]) {
+        fprintf(stderr, "failed to open %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    input->dir_len[0] = len;
+    input->depth      = 1;
+
+    return 0;
+}
+
+static void
+close_list(Input* input)
+{
+    if (input->owns_list) fclose(input->list);
+    input->list      = NULL;
+    input->owns_list = false;
+}
+
+// Returns the next non-empty line of the list, or NULL at the end.
+static const char*
+next_line(Input* input)
+{
+    ssize_t len;
+
+    while ((len = getline(&input->line, &input->line_size, input->list)) >=
+           0) {
+        while (len > 0 &&
+               (input->line[len - 1] == '\n' || input->line[len - 1] == '\r')) {
+            input->line[--len] = '\0';
+        }
+        if (len == 0) continue;
+        if ((size_t) len >= sizeof(input->path)) {
+            fprintf(stderr,
+                    "skipping %s: %s\n",
+                    input->line,
+                    strerror(ENAMETOOLONG));
+            continue;
+        }
+        memcpy(input->path, input->line, len + 1);
+        return input->path;
+    }
+
+    if (ferror(input->list)) {
+        fprintf(stderr, "failed to read image list: %s\n", strerror(errno));
+        input->error = true;
+    }
+    close_list(input);
+
+    return NULL;
+}
+
+// Returns the next matching file of the directory walk, or NULL at the end.
+static const char*
+next_entry(Input* input)
+{
+    while (input->depth > 0) {
+        int            level = input->depth - 1;
+        size_t         len   = input->dir_len[level];
+        struct dirent* entry;
+
+        errno = 0;
+        entry = readdir(input->dirs[level]);
+        if (!entry) {
+            if (errno) {
+                fprintf(stderr,
+                        "failed to read %s: %s\n",
+                        input->path,
+                        strerror(errno));
+                input->error = true;
+            }
+            closedir(input->dirs[level]);
+            input->depth--;
+            if (input->depth > 0) {
+                input->path[input->dir_len[input->depth - 1]] = '\0';
+            }
+            continue;
+        }
+
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        int n = snprintf(input->path + len,
+                         sizeof(input->path) - len,
+                         "/%s",
+                         entry->d_name);
+        if (n < 0 || (size_t) n >= sizeof(input->path) - len) {
+            input->path[len] = '\0';
+            fprintf(stderr,
+                    "skipping %s/%s: %s\n",
+                    input->path,
+                    entry->d_name,
+                    strerror(ENAMETOOLONG));
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st;
+            if (stat(input->path, &st)) {
+                type = DT_UNKNOWN;
+            } else if (S_ISDIR(st.st_mode)) {
+                type = DT_DIR;
+            } else if (S_ISREG(st.st_mode)) {
+                type = DT_REG;
+            }
+        }
+
+        if (type == DT_DIR) {
+            if (input->depth == INPUT_MAX_DEPTH) {
+                fprintf(stderr, "skipping %s: nested too deeply\n", input->path);
+            } else {
+                DIR* dir = opendir(input->path);
+                if (dir) {
+                    input->dirs[input->depth]    = dir;
+                    input->dir_len[input->depth] = len + n;
+                    input->depth++;
+                    continue;
+                }
+                fprintf(stderr,
+                        "skipping %s: %s\n",
+                        input->path,
+                        strerror(errno));
+            }
+            input->path[len] = '\0';
+            continue;
+        }
+
+        if (type == DT_REG && (!input->pattern ||
+                               fnmatch(input->pattern, entry->d_name, 0) == 0)) {
+            return input->path;
+        }
+        input->path[len] = '\0';
+    }
+
+    return NULL;
+}
+
+// Returns the path following the last one fetched, see input_next().
+static const char*
+fetch_next(Input* input)
+{
+    const char* path;
+
+    if (input->error) return NULL;
+
+    // Restore the directory prefix the previous file name was appended to.
+    if (input->depth > 0) {
+        input->path[input->dir_len[input->depth - 1]] = '\0';
+        return next_entry(input);
+    }
+
+    for (;;) {
+        if (input->list) {
+            path = next_line(input);
+            if (path || input->error) return path;
+        }
+
+        if (input->next_arg >= input->num_args) return NULL;
+
+        const char* arg = input->args[input->next_arg++];
+        if (strcmp(arg, "-") == 0) {
+            open_list(input, arg);
+            continue;
+        }
+
+        return arg;
+    }
+}
+
+// Whether fetching another path may wait for a line on stdin, which would
+// hold back the current image of an interactive list.
+static bool
+fetch_blocks(const Input* input)
+{
+    if (input->list) return !input->owns_list;
+    return input->depth == 0 && input->next_arg < input->num_args &&
+           strcmp(input->args[input->next_arg], "-") == 0;
+}
+
+const char*
+input_next(Input* input)
+{
+    if (input->has_ahead) {
+        memcpy(input->current, input->ahead, sizeof(input->current));
+        input->has_ahead = false;
+    } else {
+        const char* path = fetch_next(input);
+        if (!path) return NULL;
+        snprintf(input->current, sizeof(input->current), "%s", path);
+    }
+
+    if (!fetch_blocks(input)) {
+        const char* path = fetch_next(input);
+        if (path) {
+            snprintf(input->ahead, sizeof(input->ahead), "%s", path);
+            input->has_ahead = true;
+            mapped_file_readahead(input->ahead);
+        }
+    }
+
+    return input->current;
+}
+
+void
+input_close(Input* input)
+{
+    while (input->depth > 0) closedir(input->dirs[--input->depth]);
+    if (input->list) close_list(input);
+    free(input->line);
+    input->line = NULL;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Deepest directory nesting followed by input_open_dir().
+#define INPUT_MAX_DEPTH 32
+
+/**
+ * A lazily enumerated sequence of image paths.  Only the current and the
+ * following path are held in memory whichever the source, so the first image
+ * can be processed before the rest of a large directory or list has been
+ * read.  The file of the following path is read ahead into the page cache
+ * while the current one is processed.
+ */
+typedef struct {
+    char**      args;       // Paths given on the command line
+    int         num_args;   // Number of entries in args
+    int         next_arg;   // Next entry of args to return
+    FILE*       list;       // Open list file, one path per line
+    bool        owns_list;  // Whether list must be closed, false for stdin
+    char*       line;       // getline() buffer for list
+    size_t      line_size;  // Capacity of line
+    DIR*        dirs[INPUT_MAX_DEPTH]; // Directories being walked
+    size_t      dir_len[INPUT_MAX_DEPTH]; // Length of path for each level
+    int         depth;      // Number of open entries in dirs
+    const char* pattern;    // fnmatch() pattern for directory entries
+    bool        error;      // Set when enumeration stopped on an error
+    bool        has_ahead;  // Whether ahead holds the following path
+    char        path[PATH_MAX];
+    char        current[PATH_MAX]; // Path returned by input_next()
+    char        ahead[PATH_MAX];   // Following path, being read ahead
+} Input;
+
+/**
+ * Enumerates the count paths of args.  A path of "-" reads further paths
+ * from stdin, one per line, before continuing with the next argument.
+ */
+void
+input_open_args(Input* input, char** args, int count);
+
+/**
+ * Enumerates the list file at path, one image path per line, with "-"
+ * reading the list from stdin.  Empty lines are skipped.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+input_open_list(Input* input, const char* path);
+
+/**
+ * Walks the directory dir and its subdirectories in readdir() order,
+ * returning every regular file whose name matches pattern, or every regular
+ * file when pattern is NULL.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+input_open_dir(Input* input, const char* dir, const char* pattern);
+
+/**
+ * Returns the next image path, valid until the next call, or NULL once the
+ * input is exhausted or input->error has been set.  Unless that means
+ * waiting on stdin, the path after it is fetched as well and its file read
+ * ahead.
+ */
+const char*
+input_next(Input* input);
+
+/**
+ * Releases the directories and list file held by input.
+ */
+void
+input_close(Input* input);
+
+#endif /* INPUT_H */
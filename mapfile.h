@@ -0,0 +1,57 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A file mapped read only into memory so it can be decoded in place, without
+ * copying it through a read buffer first.
+ */
+typedef struct {
+    uint8_t* data; // Contents of the file, NULL when empty or not mapped
+    size_t   size; // Length of data in bytes
+} MappedFile;
+
+/**
+ * Maps the whole file at path into file, advising the kernel it will be read
+ * sequentially so readahead is aggressive and pages are dropped behind.
+ *
+ * Returns 0 on success or -1 with errno set.
+ */
+int
+mapped_file_open(MappedFile* file, const char* path);
+
+/**
+ * Unmaps file and resets it, safe on a file that is not mapped.
+ */
+void
+mapped_file_close(MappedFile* file);
+
+/**
+ * Asks the kernel to start reading the file at path into the page cache in
+ * the background, so a later mapped_file_open() does not wait on slow
+ * storage.  Failures are ignored, it is only a hint.
+ */
+void
+mapped_file_readahead(const char* path);
+
+#endif /* MAPFILE_H */
@@ -0,0 +1,470 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+static void
+output_flush(Output* output)
+{
+    size_t offset = 0;
+
+    while (!output->error && offset < output->used) {
+        ssize_t n =
+            write(output->fd, output->buffer + offset, output->used - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "failed to write results: %s\n", strerror(errno));
+            output->error = true;
+            break;
+        }
+        offset += n;
+    }
+
+    output->used = 0;
+}
+
+static void
+output_write(Output* output, const void* data, size_t size)
+{
+    if (output->used + size > OUTPUT_BUFFER_SIZE) output_flush(output);
+
+    // Records larger than the buffer bypass it.
+    if (size > OUTPUT_BUFFER_SIZE) {
+        const char* bytes = data;
+        while (!output->error && size) {
+            size_t chunk = size < OUTPUT_BUFFER_SIZE ? size : OUTPUT_BUFFER_SIZE;
+            memcpy(output->buffer, bytes, chunk);
+            output->used = chunk;
+            output_flush(output);
+            bytes += chunk;
+            size -= chunk;
+        }
+        return;
+    }
+
+    memcpy(output->buffer + output->used, data, size);
+    output->used += size;
+}
+
+static void
+output_printf(Output* output, const char* format, ...)
+{
+    va_list args;
+    size_t  space = OUTPUT_BUFFER_SIZE - output->used;
+
+    va_start(args, format);
+    int n = vsnprintf(output->buffer + output->used, space, format, args);
+    va_end(args);
+    if (n < 0) return;
+
+    if ((size_t) n < space) {
+        output->used += n;
+        return;
+    }
+
+    // Did not fit, flush and format again into the empty buffer.
+    output_flush(output);
+    if ((size_t) n >= OUTPUT_BUFFER_SIZE) {
+        char* line = malloc(n + 1);
+        if (!line) return;
+        va_start(args, format);
+        vsnprintf(line, n + 1, format, args);
+        va_end(args);
+        output_write(output, line, n);
+        free(line);
+        return;
+    }
+
+    va_start(args, format);
+    output->used = vsnprintf(output->buffer, OUTPUT_BUFFER_SIZE, format, args);
+    va_end(args);
+}
+
+// Writes string as a JSON string literal including the quotes.
+static void
+output_json_string(Output* output, const char* string)
+{
+    output_write(output, "\"", 1);
+    for (const unsigned char* c = (const unsigned char*) string; *c; c++) {
+        switch (*c) {
+        case '"':
+            output_write(output, "\\\"", 2);
+            break;
+        case '\\':
+            output_write(output, "\\\\", 2);
+            break;
+        case '\n':
+            output_write(output, "\\n", 2);
+            break;
+        case '\t':
+            output_write(output, "\\t", 2);
+            break;
+        default:
+            if (*c < 0x20) {
+                output_printf(output, "\\u%04x", *c);
+            } else {
+                output_write(output, c, 1);
+            }
+        }
+    }
+    output_write(output, "\"", 1);
+}
+
+// Writes string as a CSV field, quoted only when it has to be.
+static void
+output_csv_string(Output* output, const char* string)
+{
+    if (!strpbrk(string, ",\"\r\n")) {
+        output_write(output, string, strlen(string));
+        return;
+    }
+
+    output_write(output, "\"", 1);
+    for (const char* c = string; *c; c++) {
+        if (*c == '"') output_write(output, "\"", 1);
+        output_write(output, c, 1);
+    }
+    output_write(output, "\"", 1);
+}
+
+// Whether face i of job was turned down by the face gate.
+static bool
+face_skipped(const Job* job, size_t i)
+{
+    return job->face_detect && job->pose_skipped && job->skipped[i];
+}
+
+void
+output_face(const Job* job, size_t i, OutputBinFace* face)
+{
+    if (job->face_detect) {
+        const VAALBox* box = &job->boxes[i];
+        face->xmin  = box->xmin;
+        face->ymin  = box->ymin;
+        face->xmax  = box->xmax;
+        face->ymax  = box->ymax;
+        face->score = box->score;
+    } else {
+        face->xmin  = 0.0f;
+        face->ymin  = 0.0f;
+        face->xmax  = 1.0f;
+        face->ymax  = 1.0f;
+        face->score = 1.0f;
+    }
+    if (face_skipped(job, i)) {
+        face->yaw   = NAN;
+        face->pitch = NAN;
+        face->roll  = NAN;
+    } else {
+        face->yaw   = job->orientations[i].yaw;
+        face->pitch = job->orientations[i].pitch;
+        face->roll  = job->orientations[i].roll;
+    }
+    face->track = job->face_detect ? job->track_ids[i] : 0;
+}
+
+size_t
+output_faces(const Job* job)
+{
+    return job->face_detect ? job->num_boxes : 1;
+}
+
+static void
+output_text(Output* output, const Job* job)
+{
+    if (!job->face_detect) {
+        output_printf(output,
+                      "Load: %.4f Infer: %.4f Decode: %.4f \n"
+                      "Yaw: %.4f Pitch %.4f Roll %.4f\n",
+                      (job->decode_ns + job->pose.load_ns) / 1e6,
+                      job->pose.inference_ns / 1e6,
+                      job->pose.euler_ns / 1e6,
+                      job->orientations[0].yaw,
+                      job->orientations[0].pitch,
+                      job->orientations[0].roll);
+        return;
+    }
+
+    output_printf(
+        output,
+        "  [box] (scr%%): xmin ymin xmax ymax   yaw    pitch   roll\r\n");
+    output_printf(output, "Width: %d Height: %d\n", job->width, job->height);
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        const VAALBox* box = &job->boxes[j];
+        if (face_skipped(job, j)) {
+            output_printf(
+                output,
+                "  [%3zu] (%3d%%): %3.2f %3.2f %3.2f %3.2f skipped\r\n",
+                j,
+                (int) (box->score * 100),
+                box->xmin,
+                box->ymin,
+                box->xmax,
+                box->ymax);
+            continue;
+        }
+        output_printf(
+            output,
+            "  [%3zu] (%3d%%): %3.2f %3.2f %3.2f %3.2f %+3.4f %+3.4f %+3.4f\r\n",
+            j,
+            (int) (box->score * 100),
+            box->xmin,
+            box->ymin,
+            box->xmax,
+            box->ymax,
+            job->orientations[j].yaw,
+            job->orientations[j].pitch,
+            job->orientations[j].roll);
+    }
+    // Load covers decoding, the detector input and every face crop so it
+    // stays comparable between --shared_frame and reloading the file.
+    output_printf(output,
+                  "Load: %.4f Infer: %.4f Boxes: %.4f Pose: %.4f\n",
+                  (job->decode_ns + job->detect_load_ns + job->pose.load_ns) /
+                      1e6,
+                  job->detect_run_ns / 1e6,
+                  job->boxes_ns / 1e6,
+                  (job->pose.inference_ns + job->pose.euler_ns) / 1e6);
+}
+
+static void
+output_csv(Output* output, const Job* job)
+{
+    for (size_t i = 0; i < output_faces(job); i++) {
+        OutputBinFace face;
+        output_face(job, i, &face);
+        output_csv_string(output, job->path);
+        output_printf(output,
+                      ",%zu,%" PRIu32 ",%.4f,%.4f,%.4f,%.4f,%.4f",
+                      i,
+                      face.track,
+                      face.xmin,
+                      face.ymin,
+                      face.xmax,
+                      face.ymax,
+                      face.score);
+        // Skipped faces leave their orientation empty.
+        if (face_skipped(job, i)) {
+            output_write(output, ",,,\n", 4);
+        } else {
+            output_printf(output,
+                          ",%.4f,%.4f,%.4f\n",
+                          face.yaw,
+                          face.pitch,
+                          face.roll);
+        }
+    }
+}
+
+static void
+output_jsonl(Output* output, const Job* job)
+{
+    output_write(output, "{\"file\":", 8);
+    output_json_string(output, job->path);
+    output_printf(output,
+                  ",\"width\":%d,\"height\":%d,\"faces\":[",
+                  job->width,
+                  job->height);
+    for (size_t i = 0; i < output_faces(job); i++) {
+        OutputBinFace face;
+        output_face(job, i, &face);
+        // The crop is the one the head pose model was given, in pixels.
+        int32_t        whole[4] = {0, 0, job->width, job->height};
+        const int32_t* crop     = job->face_detect ? job->rois[i] : whole;
+        output_printf(output,
+                      "%s{\"track\":%" PRIu32
+                      ",\"box\":[%.4f,%.4f,%.4f,%.4f],"
+                      "\"crop\":[%d,%d,%d,%d],\"score\":%.4f",
+                      i ? "," : "",
+                      face.track,
+                      face.xmin,
+                      face.ymin,
+                      face.xmax,
+                      face.ymax,
+                      crop[0],
+                      crop[1],
+                      crop[2],
+                      crop[3],
+                      face.score);
+        if (face_skipped(job, i)) {
+            output_printf(output, ",\"skipped\":true}");
+        } else {
+            output_printf(output,
+                          ",\"yaw\":%.4f,\"pitch\":%.4f,\"roll\":%.4f}",
+                          face.yaw,
+                          face.pitch,
+                          face.roll);
+        }
+    }
+    output_write(output, "]}\n", 3);
+}
+
+static void
+output_bin(Output* output, const Job* job)
+{
+    OutputBinImage image = {
+        .index     = output->images,
+        .path_len  = strlen(job->path),
+        .width     = job->width,
+        .height    = job->height,
+        .num_faces = output_faces(job),
+    };
+
+    output_write(output, &image, sizeof(image));
+    output_write(output, job->path, image.path_len);
+    for (size_t i = 0; i < image.num_faces; i++) {
+        OutputBinFace face;
+        output_face(job, i, &face);
+        output_write(output, &face, sizeof(face));
+    }
+}
+
+int
+output_parse_format(const char* name, OutputFormat* format)
+{
+    if (strcmp(name, "text") == 0) {
+        *format = OUTPUT_TEXT;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = OUTPUT_CSV;
+    } else if (strcmp(name, "jsonl") == 0) {
+        *format = OUTPUT_JSONL;
+    } else if (strcmp(name, "bin") == 0) {
+        *format = OUTPUT_BIN;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int
+output_open(Output* output, OutputFormat format, const char* path)
+{
+    if (!path || strcmp(path, "-") == 0) {
+        // Anything printed before through stdio must come first.
+        fflush(stdout);
+        if (output_open_fd(output, format, STDOUT_FILENO)) return -1;
+        // Keep interactive output live, anything else is written in bulk.
+        output->flush = format == OUTPUT_TEXT && isatty(STDOUT_FILENO);
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (output_open_fd(output, format, fd)) {
+        close(fd);
+        return -1;
+    }
+    output->owns_fd = true;
+
+    return 0;
+}
+
+int
+output_open_fd(Output* output, OutputFormat format, int fd)
+{
+    memset(output, 0, sizeof(*output));
+    output->format = format;
+    output->fd     = fd;
+
+    output->buffer = malloc(OUTPUT_BUFFER_SIZE);
+    if (!output->buffer) {
+        fprintf(stderr, "failed to allocate output: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (format == OUTPUT_CSV) {
+        output_printf(output,
+                      "file,face,track,xmin,ymin,xmax,ymax,score,yaw,pitch,"
+                      "roll\n");
+    } else if (format == OUTPUT_BIN) {
+        uint32_t version = OUTPUT_BIN_VERSION;
+        output_write(output, OUTPUT_BIN_MAGIC, 4);
+        output_write(output, &version, sizeof(version));
+    }
+
+    return 0;
+}
+
+void
+output_job(Output* output, const Job* job)
+{
+    if (output->error) return;
+
+    switch (output->format) {
+    case OUTPUT_TEXT:
+        output_text(output, job);
+        break;
+    case OUTPUT_CSV:
+        output_csv(output, job);
+        break;
+    case OUTPUT_JSONL:
+        output_jsonl(output, job);
+        break;
+    case OUTPUT_BIN:
+        output_bin(output, job);
+        break;
+    }
+
+    output->images++;
+    if (output->flush) output_flush(output);
+}
+
+void
+output_error(Output* output, const char* path, const char* message)
+{
+    if (output->error) return;
+
+    if (output->format == OUTPUT_JSONL) {
+        output_write(output, "{\"file\":", 8);
+        output_json_string(output, path);
+        output_write(output, ",\"error\":", 9);
+        output_json_string(output, message);
+        output_write(output, "}\n", 2);
+    } else if (output->format == OUTPUT_TEXT) {
+        output_printf(output, "Error: %s: %s\n", path, message);
+    }
+
+    if (output->flush) output_flush(output);
+}
+
+int
+output_close(Output* output)
+{
+    output_flush(output);
+    if (output->owns_fd && close(output->fd) && !output->error) {
+        fprintf(stderr, "failed to close results: %s\n", strerror(errno));
+        output->error = true;
+    }
+    free(output->buffer);
+    output->buffer = NULL;
+    return output->error ? -1 : 0;
+}
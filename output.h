@@ -0,0 +1,144 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stages.h"
+
+// Size of the output buffer, results are written in chunks of this size.
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// Leading bytes of a binary result stream.
+#define OUTPUT_BIN_MAGIC "HPOS"
+#define OUTPUT_BIN_VERSION 2
+
+typedef enum {
+    OUTPUT_TEXT = 0, // Human readable lines, the default
+    OUTPUT_CSV,      // One row per face with a header row
+    OUTPUT_JSONL,    // One JSON object per image
+    OUTPUT_BIN,      // Fixed size native endian records, see below
+} OutputFormat;
+
+/**
+ * The binary format starts with OUTPUT_BIN_MAGIC followed by a uint32_t
+ * OUTPUT_BIN_VERSION.  Every image is then an OutputBinImage followed by
+ * path_len bytes of path, without terminator, and num_faces OutputBinFace.
+ */
+typedef struct {
+    uint32_t index;     // Position of the image in the input
+    uint32_t path_len;  // Length of the path following this record
+    int32_t  width;     // Image width in pixels
+    int32_t  height;    // Image height in pixels
+    uint32_t num_faces; // Number of OutputBinFace following the path
+} OutputBinImage;
+
+typedef struct {
+    float    xmin;  // Box normalized to the image, 0..1
+    float    ymin;
+    float    xmax;
+    float    ymax;
+    float    score; // Detection score, 1 when detection is disabled
+    float    yaw;   // Head orientation in degrees, NaN when skipped
+    float    pitch;
+    float    roll;
+    uint32_t track; // Tracked face identifier, 0 when not tracking
+} OutputBinFace;
+
+/**
+ * A buffered result writer.  Records are formatted straight into a large
+ * buffer which is written to the file descriptor only when full, on close
+ * or, for text on a terminal, after every image.
+ */
+typedef struct {
+    OutputFormat format;
+    int          fd;       // Destination descriptor
+    bool         owns_fd;  // Whether fd must be closed
+    bool         flush;    // Flush after every image
+    bool         error;    // A write failed, further output is dropped
+    uint32_t     images;   // Images written so far
+    char*        buffer;
+    size_t       used;
+} Output;
+
+/**
+ * Number of faces reported for job, 1 for the whole image when face
+ * detection is disabled.
+ */
+size_t
+output_faces(const Job* job);
+
+/**
+ * Fills face with face i of job, below output_faces(job), as written by the
+ * binary format.
+ */
+void
+output_face(const Job* job, size_t i, OutputBinFace* face);
+
+/**
+ * Parses name, one of text, csv, jsonl or bin, into format.
+ *
+ * Returns 0 on success or -1 if name is not a known format.
+ */
+int
+output_parse_format(const char* name, OutputFormat* format);
+
+/**
+ * Opens output for writing format to the file at path, or to stdout when
+ * path is NULL or "-".
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+output_open(Output* output, OutputFormat format, const char* path);
+
+/**
+ * Opens output for writing format to the already open descriptor fd, which
+ * is left open by output_close().
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+output_open_fd(Output* output, OutputFormat format, int fd);
+
+/**
+ * Writes the results of a completed job.
+ */
+void
+output_job(Output* output, const Job* job);
+
+/**
+ * Reports that the image at path could not be processed.  Only the text and
+ * jsonl formats have an error record, the others write nothing.
+ */
+void
+output_error(Output* output, const char* path, const char* message);
+
+/**
+ * Flushes and closes output.
+ *
+ * Returns 0 on success or -1 if any write failed.
+ */
+int
+output_close(Output* output);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,256 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+// Jobs in flight per decoder thread, bounds the memory held by decoded
+// frames waiting for the detector.
+#define JOBS_PER_DECODER 2
+
+typedef enum {
+    JOB_EMPTY = 0,
+    JOB_QUEUED,
+    JOB_DECODED,
+    JOB_DETECTED,
+    JOB_FAILED,
+} JobState;
+
+typedef struct {
+    const Stages*   stages;
+    PipelineOutput  output;
+    void*           user;
+    Job*            jobs;
+    JobState*       state;
+    size_t          depth;
+    size_t          submitted; // Jobs handed to the ring by the producer
+    size_t          decoding;  // Next job to be claimed by a decoder
+    size_t          finished;  // Jobs passed to output and recycled
+    bool            input_done;
+    bool            failed;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} Pipeline;
+
+// Blocks until job seq reaches state or failed in an earlier stage and
+// returns the state reached.  Returns JOB_EMPTY when the pipeline stopped or
+// input ended before seq was submitted.
+static JobState
+wait_for(Pipeline* p, size_t seq, JobState state)
+{
+    JobState reached = JOB_EMPTY;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        if (p->failed) break;
+        if (seq < p->submitted) {
+            JobState current = p->state[seq % p->depth];
+            if (current == state || current == JOB_FAILED) {
+                reached = current;
+                break;
+            }
+        }
+        if (p->input_done && seq >= p->submitted) break;
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return reached;
+}
+
+// A job failing in any stage is carried through the later stages so images
+// ahead of it are still reported in order before the pipeline stops.
+static void
+advance(Pipeline* p, size_t seq, JobState state, bool ok)
+{
+    pthread_mutex_lock(&p->lock);
+    p->state[seq % p->depth] = ok ? state : JOB_FAILED;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void*
+decode_thread(void* arg)
+{
+    Pipeline* p = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->failed && p->decoding >= p->submitted && !p->input_done) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        if (p->failed || p->decoding >= p->submitted) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        size_t seq = p->decoding++;
+        pthread_mutex_unlock(&p->lock);
+
+        Job* job = &p->jobs[seq % p->depth];
+        advance(p, seq, JOB_DECODED, stage_decode(p->stages, job) == 0);
+    }
+}
+
+static void*
+detect_thread(void* arg)
+{
+    Pipeline* p = arg;
+
+    for (size_t seq = 0;; seq++) {
+        JobState state = wait_for(p, seq, JOB_DECODED);
+        if (state == JOB_EMPTY) return NULL;
+        if (state == JOB_FAILED) continue;
+
+        Job* job = &p->jobs[seq % p->depth];
+        advance(p, seq, JOB_DETECTED, stage_detect(p->stages, job) == 0);
+    }
+}
+
+static void*
+pose_thread(void* arg)
+{
+    Pipeline* p = arg;
+
+    for (size_t seq = 0;; seq++) {
+        JobState state = wait_for(p, seq, JOB_DETECTED);
+        if (state == JOB_EMPTY) return NULL;
+
+        Job* job = &p->jobs[seq % p->depth];
+        bool ok  = state == JOB_DETECTED && stage_pose(p->stages, job) == 0;
+        if (ok) p->output(job, p->user);
+
+        pthread_mutex_lock(&p->lock);
+        if (ok) {
+            p->state[seq % p->depth] = JOB_EMPTY;
+            p->finished++;
+        } else {
+            p->failed = true;
+        }
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+int
+pipeline_run(const Stages*  stages,
+             int            decoders,
+             Input*         input,
+             PipelineOutput output,
+             void*          user)
+{
+    Stages     shared = *stages;
+    Pipeline   p      = {0};
+    pthread_t* decode = NULL;
+    pthread_t  detect, pose;
+    int        started     = 0;
+    bool       have_detect = false;
+    bool       have_pose   = false;
+    int        err         = 0;
+
+    shared.shared_frame = true;
+
+    p.stages = &shared;
+    p.output = output;
+    p.user   = user;
+    p.depth  = (size_t) decoders * JOBS_PER_DECODER + 2;
+    p.jobs   = calloc(p.depth, sizeof(Job));
+    p.state  = calloc(p.depth, sizeof(JobState));
+    decode   = calloc(decoders, sizeof(pthread_t));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+
+    if (!p.jobs || !p.state || !decode) {
+        fprintf(stderr, "failed to allocate pipeline: %s\n", strerror(errno));
+        err = -1;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < p.depth; i++) {
+        if (job_init(&p.jobs[i], stages->max_detection)) {
+            fprintf(stderr,
+                    "failed to allocate pipeline: %s\n",
+                    strerror(errno));
+            err = -1;
+            goto cleanup;
+        }
+    }
+
+    for (started = 0; started < decoders; started++) {
+        if (pthread_create(&decode[started], NULL, decode_thread, &p)) break;
+    }
+    have_detect = pthread_create(&detect, NULL, detect_thread, &p) == 0;
+    have_pose   = pthread_create(&pose, NULL, pose_thread, &p) == 0;
+    if (started == 0 || !have_detect || !have_pose) {
+        fprintf(stderr, "failed to start pipeline threads\n");
+        pthread_mutex_lock(&p.lock);
+        p.failed = true;
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
+    }
+
+    // The producer only refills a slot once the pose stage recycled it, which
+    // is what bounds every queue between the stages.
+    const char* path;
+    while ((path = input_next(input))) {
+        pthread_mutex_lock(&p.lock);
+        while (!p.failed && p.submitted - p.finished >= p.depth) {
+            pthread_cond_wait(&p.cond, &p.lock);
+        }
+        if (p.failed) {
+            pthread_mutex_unlock(&p.lock);
+            break;
+        }
+        size_t slot = p.submitted % p.depth;
+        pthread_mutex_unlock(&p.lock);
+
+        snprintf(p.jobs[slot].path, sizeof(p.jobs[slot].path), "%s", path);
+
+        pthread_mutex_lock(&p.lock);
+        p.state[slot] = JOB_QUEUED;
+        p.submitted++;
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.input_done = true;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+
+    for (int i = 0; i < started; i++) pthread_join(decode[i], NULL);
+    if (have_detect) pthread_join(detect, NULL);
+    if (have_pose) pthread_join(pose, NULL);
+
+    if (p.failed || input->error) err = -1;
+
+cleanup:
+    if (p.jobs) {
+        for (size_t i = 0; i < p.depth; i++) job_release(&p.jobs[i]);
+    }
+    free(p.jobs);
+    free(p.state);
+    free(decode);
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+
+    return err;
+}
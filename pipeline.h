@@ -0,0 +1,47 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "input.h"
+#include "stages.h"
+
+/**
+ * Called from the pose thread for every image, in input order, once its
+ * results are complete.
+ */
+typedef void (*PipelineOutput)(const Job* job, void* user);
+
+/**
+ * Runs the images enumerated from input through a pool of decoders threads,
+ * a face detection thread and a head pose thread connected by a bounded ring
+ * of jobs, so decoding of the next images overlaps inference of the current
+ * one.  Frames are always shared between the stages in this mode.
+ *
+ * Returns 0 once every image has been passed to output or -1 if any stage
+ * failed, in which case the remaining images are abandoned.
+ */
+int
+pipeline_run(const Stages*  stages,
+             int            decoders,
+             Input*         input,
+             PipelineOutput output,
+             void*          user);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,373 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pool.h"
+
+// Jobs in flight per worker, enough for every worker to have one queued
+// behind the one it is running.
+#define JOBS_PER_WORKER 2
+
+typedef enum {
+    JOB_EMPTY = 0,
+    JOB_QUEUED,
+    JOB_DONE,
+    JOB_FAILED,
+} JobState;
+
+/**
+ * A bounded double-ended queue of job sequence numbers.  The owner takes the
+ * oldest job from the head, thieves take the newest from the tail so they
+ * rarely contend with the owner.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t*         seqs;
+    size_t          capacity;
+    size_t          head;
+    size_t          count;
+} Deque;
+
+typedef struct Pool Pool;
+
+typedef struct {
+    Pool*     pool;
+    int       index;
+    int       cpu;
+    Stages    own;
+    Stages*   stages;
+    bool      open;    // Creates stages on its thread
+    Deque     queue;
+    pthread_t thread;
+    bool      started;
+} Worker;
+
+struct Pool {
+    const StagesConfig* config;
+    Worker*             workers;
+    int                 num_workers;
+    Job*                jobs;
+    JobState*           state;
+    size_t              depth;
+    size_t              submitted; // Jobs dealt to the worker queues
+    size_t              finished;  // Jobs passed to output and recycled
+    size_t              queued;    // Jobs in queues not yet claimed
+    int                 ready;     // Workers that finished creating contexts
+    bool                input_done;
+    bool                failed;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+};
+
+int
+pool_parse_cpus(const char* list, int* cpus, int max_cpus)
+{
+    int         count = 0;
+    const char* p     = list;
+
+    while (*p) {
+        char* end;
+        long  first = strtol(p, &end, 10);
+        long  last  = first;
+        if (end == p || first < 0) return -1;
+        if (*end == '-') {
+            p    = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (count == max_cpus) return -1;
+            cpus[count++] = (int) cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end) {
+            return -1;
+        }
+        p = end;
+    }
+
+    return count ? count : -1;
+}
+
+static void
+deque_push(Deque* q, size_t seq)
+{
+    pthread_mutex_lock(&q->lock);
+    q->seqs[(q->head + q->count++) % q->capacity] = seq;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static bool
+deque_take(Deque* q, bool steal, size_t* seq)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->count) {
+        if (steal) {
+            *seq = q->seqs[(q->head + q->count - 1) % q->capacity];
+        } else {
+            *seq    = q->seqs[q->head];
+            q->head = (q->head + 1) % q->capacity;
+        }
+        q->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return found;
+}
+
+// Waits for a job to be available and claims it, preferring the worker's own
+// queue.  Returns false once input is exhausted or the pool failed.
+static bool
+claim(Worker* worker, size_t* seq)
+{
+    Pool* pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->failed && !pool->queued && !pool->input_done) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    if (pool->failed || !pool->queued) {
+        pthread_mutex_unlock(&pool->lock);
+        return false;
+    }
+    pool->queued--;
+    pthread_mutex_unlock(&pool->lock);
+
+    // Every claim is backed by a job in one of the queues, keep looking
+    // until it is found as another worker may have stolen from ours.
+    for (;;) {
+        if (deque_take(&worker->queue, false, seq)) return true;
+        for (int i = 1; i < pool->num_workers; i++) {
+            Worker* victim =
+                &pool->workers[(worker->index + i) % pool->num_workers];
+            if (deque_take(&victim->queue, true, seq)) return true;
+        }
+        sched_yield();
+    }
+}
+
+static void*
+worker_thread(void* arg)
+{
+    Worker* worker = arg;
+    Pool*   pool   = worker->pool;
+    bool    ok     = true;
+
+    if (worker->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            fprintf(stderr,
+                    "failed to pin worker %d to cpu %d\n",
+                    worker->index,
+                    worker->cpu);
+        }
+    }
+
+    // Contexts are created on the worker so their buffers are first touched
+    // from the CPU it is pinned to.  Unpinned, worker 0 was handed the
+    // contexts of the calling thread rather than loading the models again.
+    if (worker->open) ok = stages_open(worker->stages, pool->config) == 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->ready++;
+    if (!ok) pool->failed = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    size_t seq;
+    while (ok && claim(worker, &seq)) {
+        Job* job = &pool->jobs[seq % pool->depth];
+        bool done = stage_decode(worker->stages, job) == 0 &&
+                    stage_detect(worker->stages, job) == 0 &&
+                    stage_pose(worker->stages, job) == 0;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->state[seq % pool->depth] = done ? JOB_DONE : JOB_FAILED;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (worker->stages == &worker->own) stages_close(&worker->own);
+    return NULL;
+}
+
+int
+pool_run(Stages*             stages,
+         const StagesConfig* config,
+         int                 workers,
+         const int*          cpus,
+         int                 num_cpus,
+         Input*              input,
+         PoolReady           ready,
+         PipelineOutput      output,
+         void*               user)
+{
+    Pool        pool  = {0};
+    int         err   = 0;
+    int         dealt = 0;
+    bool        more  = true;
+    const char* path  = NULL;
+
+    pool.config      = config;
+    pool.num_workers = workers;
+    pool.depth       = (size_t) workers * JOBS_PER_WORKER;
+    pool.workers     = calloc(workers, sizeof(Worker));
+    pool.jobs        = calloc(pool.depth, sizeof(Job));
+    pool.state       = calloc(pool.depth, sizeof(JobState));
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    if (!pool.workers || !pool.jobs || !pool.state) {
+        fprintf(stderr, "failed to allocate pool: %s\n", strerror(errno));
+        err = -1;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < pool.depth; i++) {
+        if (job_init(&pool.jobs[i], config->max_detection)) {
+            fprintf(stderr, "failed to allocate pool: %s\n", strerror(errno));
+            err = -1;
+            goto cleanup;
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        Worker* worker = &pool.workers[i];
+        worker->pool   = &pool;
+        worker->index  = i;
+        worker->cpu    = cpus ? cpus[i % num_cpus] : -1;
+        worker->stages = i == 0 ? stages : &worker->own;
+        worker->open   = i != 0 || cpus;
+        worker->queue.capacity = pool.depth;
+        worker->queue.seqs     = calloc(pool.depth, sizeof(size_t));
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        if (!worker->queue.seqs) {
+            fprintf(stderr, "failed to allocate pool: %s\n", strerror(errno));
+            err = -1;
+            goto cleanup;
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        Worker* worker  = &pool.workers[i];
+        worker->started =
+            pthread_create(&worker->thread, NULL, worker_thread, worker) == 0;
+        if (!worker->started) {
+            fprintf(stderr, "failed to start worker %d\n", i);
+            pthread_mutex_lock(&pool.lock);
+            pool.failed = true;
+            pool.ready++;
+            pthread_mutex_unlock(&pool.lock);
+        }
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.ready < workers) pthread_cond_wait(&pool.cond, &pool.lock);
+    if (!pool.failed && ready) {
+        pthread_mutex_unlock(&pool.lock);
+        ready(stages, user);
+        pthread_mutex_lock(&pool.lock);
+    }
+
+    // Deal images to the workers round-robin while passing completed jobs to
+    // output strictly in order, a slot is only reused once output.
+    for (;;) {
+        if (pool.failed) break;
+
+        size_t oldest = pool.finished % pool.depth;
+        if (pool.finished < pool.submitted &&
+            pool.state[oldest] >= JOB_DONE) {
+            bool done = pool.state[oldest] == JOB_DONE;
+            pthread_mutex_unlock(&pool.lock);
+            if (done) output(&pool.jobs[oldest], user);
+            pthread_mutex_lock(&pool.lock);
+            if (!done) {
+                pool.failed = true;
+                break;
+            }
+            pool.state[oldest] = JOB_EMPTY;
+            pool.finished++;
+            continue;
+        }
+
+        if (more && pool.submitted - pool.finished < pool.depth) {
+            size_t seq = pool.submitted;
+            Job*   job = &pool.jobs[seq % pool.depth];
+            pthread_mutex_unlock(&pool.lock);
+
+            path = input_next(input);
+            if (!path) {
+                more = false;
+                pthread_mutex_lock(&pool.lock);
+                continue;
+            }
+            snprintf(job->path, sizeof(job->path), "%s", path);
+            deque_push(&pool.workers[dealt++ % workers].queue, seq);
+
+            pthread_mutex_lock(&pool.lock);
+            pool.state[seq % pool.depth] = JOB_QUEUED;
+            pool.submitted++;
+            pool.queued++;
+            pthread_cond_broadcast(&pool.cond);
+            continue;
+        }
+
+        if (!more && pool.finished == pool.submitted) break;
+        pthread_cond_wait(&pool.cond, &pool.lock);
+    }
+
+    pool.input_done = true;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < workers; i++) {
+        if (pool.workers[i].started) pthread_join(pool.workers[i].thread, NULL);
+    }
+
+    if (pool.failed || input->error) err = -1;
+
+cleanup:
+    if (pool.workers) {
+        for (int i = 0; i < workers; i++) {
+            free(pool.workers[i].queue.seqs);
+            pthread_mutex_destroy(&pool.workers[i].queue.lock);
+        }
+    }
+    if (pool.jobs) {
+        for (size_t i = 0; i < pool.depth; i++) job_release(&pool.jobs[i]);
+    }
+    free(pool.workers);
+    free(pool.jobs);
+    free(pool.state);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+
+    return err;
+}
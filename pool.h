@@ -0,0 +1,67 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "input.h"
+#include "pipeline.h"
+#include "stages.h"
+
+// Upper bound on the CPUs accepted by pool_parse_cpus().
+#define POOL_MAX_CPUS 256
+
+/**
+ * Parses a CPU list such as "0-3" or "0,2,4-7" into cpus.
+ *
+ * Returns the number of CPUs stored or -1 if list is malformed.
+ */
+int
+pool_parse_cpus(const char* list, int* cpus, int max_cpus);
+
+/**
+ * Called on the thread of pool_run() with the contexts of worker 0 once every
+ * worker has created its own, before any output.
+ */
+typedef void (*PoolReady)(const Stages* stages, void* user);
+
+/**
+ * Runs the images enumerated from input over workers independent context
+ * pairs, each owned by a worker thread pinned to cpus[i % num_cpus] when cpus
+ * is not NULL.  Without cpus worker 0 uses the contexts already open in
+ * stages, with cpus it opens them into stages from config on its thread
+ * after pinning, left open for the caller to close either way.  Every other
+ * worker creates its own from config on its thread after pinning.  Once all
+ * are created ready, unless NULL, is called.  Images are dealt round-robin
+ * to per-worker queues and idle workers steal from the others, output is
+ * passed to output in input order from the calling thread.
+ *
+ * Returns 0 once every image has been passed to output or -1 on failure.
+ */
+int
+pool_run(Stages*             stages,
+         const StagesConfig* config,
+         int                 workers,
+         const int*          cpus,
+         int                 num_cpus,
+         Input*              input,
+         PoolReady           ready,
+         PipelineOutput      output,
+         void*               user);
+
+#endif /* POOL_H */
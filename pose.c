@@ -0,0 +1,584 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pose.h"
+#include "trace.h"
+
+// Runs the model of a batch on its own thread so the crops of the next chunk
+// are loaded into the buffer it is not reading meanwhile.
+struct PoseWorker {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            submitted;        // The input holds a chunk still running
+    bool            stopping;         // The thread must exit
+    VAALError       err;              // Outcome of the chunk
+    size_t          num_orientations; // Decoded into batch->results
+    int64_t         inference_ns;
+    int64_t         euler_ns;
+};
+
+// Creates a view onto each of the n batch elements of tensor.
+static int
+slots_init(NNTensor* tensor, int32_t n, NNTensor*** slots)
+{
+    const int32_t* shape = nn_tensor_shape(tensor);
+
+    // Each slot is a 1xHxWxC view so a crop is resized straight into its
+    // place in the batch without an intermediate tensor.
+    int32_t slot_shape[4] = {1, shape[1], shape[2], shape[3]};
+    int32_t slot_volume   = shape[1] * shape[2] * shape[3];
+
+    *slots = calloc(n, sizeof(NNTensor*));
+    if (!*slots) return -1;
+
+    for (int32_t i = 0; i < n; i++) {
+        void* memory = calloc(1, nn_tensor_sizeof());
+        if (!memory) return -1;
+
+        (*slots)[i] = nn_tensor_init(memory, nn_tensor_engine(tensor));
+        if (nn_tensor_view((*slots)[i],
+                           nn_tensor_type(tensor),
+                           4,
+                           slot_shape,
+                           tensor,
+                           i * slot_volume)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+slots_release(NNTensor** slots, int32_t n)
+{
+    if (!slots) return;
+    for (int32_t i = 0; i < n; i++) {
+        if (!slots[i]) continue;
+        nn_tensor_release(slots[i]);
+        free(slots[i]);
+    }
+    free(slots);
+}
+
+static void*
+worker_thread(void* arg)
+{
+    PoseBatch*  batch  = arg;
+    PoseWorker* worker = batch->worker;
+
+    pthread_mutex_lock(&worker->lock);
+    for (;;) {
+        while (!worker->stopping && !worker->submitted) {
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        }
+        if (worker->stopping) break;
+        pthread_mutex_unlock(&worker->lock);
+
+        size_t    num_orientations = 0;
+        int64_t   start            = vaal_clock_now();
+        VAALError err              = vaal_run_model(batch->ctx);
+        int64_t   inference_ns     = vaal_clock_now() - start;
+        trace_span("pose_run", start, start + inference_ns);
+
+        start = vaal_clock_now();
+        if (!err) {
+            err = vaal_euler(batch->ctx, batch->results, &num_orientations);
+        }
+        trace_span_arg("vaal_euler",
+                       start,
+                       vaal_clock_now(),
+                       "faces",
+                       (int64_t) num_orientations);
+
+        pthread_mutex_lock(&worker->lock);
+        worker->err              = err;
+        worker->num_orientations = num_orientations;
+        worker->inference_ns     = inference_ns;
+        worker->euler_ns         = vaal_clock_now() - start;
+        worker->submitted        = false;
+        pthread_cond_broadcast(&worker->cond);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+// Starts running the chunk loaded into the input.
+static void
+worker_submit(PoseWorker* worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    worker->submitted = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// Waits until the submitted chunk, if any, has finished running.
+static void
+worker_idle(PoseWorker* worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->submitted) pthread_cond_wait(&worker->cond, &worker->lock);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+int
+pose_batch_init(PoseBatch* batch, VAALContext* ctx)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->ctx   = ctx;
+    batch->input = vaal_input_tensor(ctx, 0);
+    batch->batch = 1;
+
+    if (!batch->input) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const int32_t* shape = nn_tensor_shape(batch->input);
+    if (nn_tensor_dims(batch->input) == 4 && shape[0] > 1) {
+        batch->batch = shape[0];
+    }
+
+    batch->results = calloc(batch->batch, sizeof(VAALEuler));
+    if (!batch->results) return -1;
+
+    if (batch->batch == 1) return 0;
+
+    batch->num_slots = batch->batch;
+    return slots_init(batch->input, batch->num_slots, &batch->slots);
+}
+
+int
+pose_batch_preprocess(PoseBatch* batch, PreprocessKernel kernel, int norm)
+{
+    if (kernel == PREPROCESS_VAAL) return 0;
+
+    Preprocess* pre = calloc(1, sizeof(Preprocess));
+    if (!pre) return -1;
+
+    // Every slot shares the layout of the first.
+    NNTensor* tensor = batch->slots ? batch->slots[0] : batch->input;
+    if (preprocess_init(pre, kernel, tensor, norm)) {
+        free(pre);
+        return -1;
+    }
+
+    batch->preprocess = pre;
+    return 0;
+}
+
+// Binds the input tensor of batch to buffer i, read by the model from its
+// next run on.  The input points into the mapping of the buffer, which
+// engine tensors only keep valid until unmapped, so the bound buffer stays
+// mapped until the input is bound to the other one.
+static int
+buffer_bind(PoseBatch* batch, int i)
+{
+    NNTensor* buffer = batch->buffers[i];
+    void*     data   = nn_tensor_maprw(buffer);
+    if (!data) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (nn_tensor_assign(batch->input,
+                         nn_tensor_type(buffer),
+                         nn_tensor_dims(buffer),
+                         nn_tensor_shape(buffer),
+                         data)) {
+        nn_tensor_unmap(buffer);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (batch->bound >= 0) nn_tensor_unmap(batch->buffers[batch->bound]);
+    batch->bound = i;
+    return 0;
+}
+
+static void
+buffers_release(PoseBatch* batch)
+{
+    if (batch->bound >= 0 && batch->buffers[batch->bound]) {
+        nn_tensor_unmap(batch->buffers[batch->bound]);
+    }
+    batch->bound = -1;
+
+    for (int i = 0; i < 2; i++) {
+        slots_release(batch->buffer_slots[i], batch->num_slots);
+        batch->buffer_slots[i] = NULL;
+        if (!batch->buffers[i]) continue;
+        nn_tensor_release(batch->buffers[i]);
+        free(batch->buffers[i]);
+        batch->buffers[i] = NULL;
+    }
+}
+
+// Allocates both buffers like the input, with their views, and binds the
+// input to the first.
+static int
+buffers_init(PoseBatch* batch)
+{
+    NNTensor* input = batch->input;
+
+    batch->bound = -1;
+    for (int i = 0; i < 2; i++) {
+        void* memory = calloc(1, nn_tensor_sizeof());
+        if (!memory) return -1;
+        batch->buffers[i] = nn_tensor_init(memory, nn_tensor_engine(input));
+        if (nn_tensor_alloc(batch->buffers[i],
+                            nn_tensor_type(input),
+                            nn_tensor_dims(input),
+                            nn_tensor_shape(input))) {
+            free(batch->buffers[i]);
+            batch->buffers[i] = NULL;
+            errno             = ENOMEM;
+            return -1;
+        }
+        if (batch->slots && slots_init(batch->buffers[i],
+                                       batch->num_slots,
+                                       &batch->buffer_slots[i])) {
+            return -1;
+        }
+    }
+
+    return buffer_bind(batch, 0);
+}
+
+int
+pose_batch_async(PoseBatch* batch)
+{
+    // Unless the input is bound to the first buffer it keeps its own memory.
+    if (buffers_init(batch)) {
+        int err = errno;
+        buffers_release(batch);
+        errno = err;
+        return -1;
+    }
+
+    PoseWorker* worker = calloc(1, sizeof(PoseWorker));
+    if (!worker) return -1;
+    if (pthread_mutex_init(&worker->lock, NULL)) {
+        free(worker);
+        return -1;
+    }
+    if (pthread_cond_init(&worker->cond, NULL)) {
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+        return -1;
+    }
+
+    batch->worker = worker;
+    int err       = pthread_create(&worker->thread, NULL, worker_thread, batch);
+    if (err) {
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+        batch->worker = NULL;
+        errno         = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+pose_batch_release(PoseBatch* batch)
+{
+    PoseWorker* worker = batch->worker;
+    if (worker) {
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = true;
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+
+        pthread_join(worker->thread, NULL);
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+    }
+
+    buffers_release(batch);
+
+    if (batch->preprocess) {
+        preprocess_release(batch->preprocess);
+        free(batch->preprocess);
+    }
+
+    slots_release(batch->slots, batch->num_slots);
+    free(batch->results);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Loads, runs and decodes one chunk of faces after the other.
+static VAALError
+run_serial(PoseBatch*   batch,
+           const Frame* frame,
+           const char*  path,
+           int32_t      (*rois)[4],
+           size_t       count,
+           VAALEuler*   orientations,
+           PoseTiming*  timing)
+{
+    VAALError err;
+    int64_t   start, load_ns, inference_ns, euler_ns;
+    int64_t*  face_ns = timing ? timing->face_ns : NULL;
+
+    // Once bound to a buffer the input is only reached through its views.
+    NNTensor** slots =
+        batch->buffers[0] ? batch->buffer_slots[batch->bound] : batch->slots;
+
+    for (size_t first = 0; first < count;) {
+        size_t n = MIN(count - first, (size_t) batch->batch);
+
+        load_ns = 0;
+        for (size_t i = 0; i < n; i++) {
+            NNTensor* slot = slots ? slots[i] : NULL;
+            start          = vaal_clock_now();
+            if (frame && batch->preprocess &&
+                !preprocess_load(batch->preprocess,
+                                 slot ? slot : batch->input,
+                                 frame,
+                                 rois[first + i])) {
+                err = VAAL_SUCCESS;
+            } else if (frame) {
+                err = frame_load_tensor(batch->ctx, slot, frame, rois[first + i]);
+            } else {
+                err = vaal_load_image_file(batch->ctx,
+                                           slot,
+                                           path,
+                                           rois[first + i],
+                                           0);
+            }
+            int64_t ns = vaal_clock_now() - start;
+            if (err) return err;
+            trace_span_arg("pose_load",
+                           start,
+                           start + ns,
+                           "face",
+                           (int64_t) (first + i));
+            if (face_ns) face_ns[first + i] = ns;
+            load_ns += ns;
+        }
+
+        start        = vaal_clock_now();
+        err          = vaal_run_model(batch->ctx);
+        inference_ns = vaal_clock_now() - start;
+        trace_span_arg("pose_run",
+                       start,
+                       start + inference_ns,
+                       "faces",
+                       (int64_t) n);
+        if (err) return err;
+
+        size_t num_orientations = 0;
+        start                   = vaal_clock_now();
+        err      = vaal_euler(batch->ctx, batch->results, &num_orientations);
+        euler_ns = vaal_clock_now() - start;
+        trace_span_arg("vaal_euler",
+                       start,
+                       start + euler_ns,
+                       "faces",
+                       (int64_t) n);
+        if (err) return err;
+
+        if (num_orientations < n) {
+            // The decoder only covers the first batch element, so run this
+            // model one face at a time from here on and redo the chunk.
+            batch->batch = 1;
+            continue;
+        }
+
+        if (timing) {
+            timing->load_ns += load_ns;
+            timing->inference_ns += inference_ns;
+            timing->euler_ns += euler_ns;
+        }
+        if (face_ns) {
+            for (size_t i = 0; i < n; i++) {
+                face_ns[first + i] += (inference_ns + euler_ns) / (int64_t) n;
+            }
+        }
+
+        memcpy(&orientations[first], batch->results, n * sizeof(VAALEuler));
+        first += n;
+    }
+
+    return VAAL_SUCCESS;
+}
+
+// Loads the n crops of frame given by rois from first on into tensor, or its
+// slots when batched, storing the time of each in face_ns when not NULL.
+static VAALError
+load_chunk(PoseBatch*   batch,
+           NNTensor*    tensor,
+           NNTensor**   slots,
+           const Frame* frame,
+           int32_t      (*rois)[4],
+           size_t       first,
+           size_t       n,
+           int64_t*     face_ns,
+           int64_t*     load_ns)
+{
+    for (size_t i = first; i < first + n; i++) {
+        NNTensor* target = slots ? slots[i - first] : tensor;
+        int64_t   start  = vaal_clock_now();
+        VAALError err    = VAAL_SUCCESS;
+
+        if (preprocess_load(batch->preprocess, target, frame, rois[i])) {
+            // VAAL may need the context the model is running on.
+            worker_idle(batch->worker);
+            err = frame_load_tensor(batch->ctx, target, frame, rois[i]);
+        }
+        int64_t ns = vaal_clock_now() - start;
+        if (err) return err;
+        trace_span_arg("pose_load", start, start + ns, "face", (int64_t) i);
+        if (face_ns) face_ns[i] = ns;
+        *load_ns += ns;
+    }
+
+    return VAAL_SUCCESS;
+}
+
+// Loads the crops of the next chunk into the buffer the input is not bound
+// to while the current chunk runs on the worker, then binds the input to
+// it once the model is done.
+static VAALError
+run_async(PoseBatch*   batch,
+          const Frame* frame,
+          int32_t      (*rois)[4],
+          size_t       count,
+          VAALEuler*   orientations,
+          PoseTiming*  timing)
+{
+    PoseWorker* worker  = batch->worker;
+    int64_t*    face_ns = timing ? timing->face_ns : NULL;
+    size_t      n       = MIN(count, (size_t) batch->batch);
+    int64_t     load_ns = 0;
+    int         k       = batch->bound;
+    VAALError   err;
+
+    // Nothing runs yet so the first chunk goes straight into the input.
+    err = load_chunk(batch,
+                     batch->buffers[k],
+                     batch->buffer_slots[k],
+                     frame,
+                     rois,
+                     0,
+                     n,
+                     face_ns,
+                     &load_ns);
+    if (err) return err;
+    worker_submit(worker);
+
+    for (size_t first = 0;;) {
+        size_t  next      = first + n;
+        size_t  m         = MIN(count - next, (size_t) batch->batch);
+        int64_t next_load = 0;
+
+        if (m) {
+            err = load_chunk(batch,
+                             batch->buffers[1 - k],
+                             batch->buffer_slots[1 - k],
+                             frame,
+                             rois,
+                             next,
+                             m,
+                             face_ns,
+                             &next_load);
+        }
+
+        worker_idle(worker);
+        if (err) return err;
+        if (worker->err) return worker->err;
+
+        if (worker->num_orientations < n) {
+            // The decoder only covers the first batch element, finish one
+            // face at a time from this chunk on.
+            batch->batch    = 1;
+            PoseTiming rest = {.face_ns = face_ns ? face_ns + first : NULL};
+            err             = run_serial(batch,
+                                         frame,
+                                         NULL,
+                                         rois + first,
+                                         count - first,
+                                         orientations + first,
+                                         &rest);
+            if (timing) {
+                timing->load_ns += rest.load_ns;
+                timing->inference_ns += rest.inference_ns;
+                timing->euler_ns += rest.euler_ns;
+            }
+            return err;
+        }
+
+        if (timing) {
+            timing->load_ns += load_ns;
+            timing->inference_ns += worker->inference_ns;
+            timing->euler_ns += worker->euler_ns;
+        }
+        if (face_ns) {
+            int64_t share =
+                (worker->inference_ns + worker->euler_ns) / (int64_t) n;
+            for (size_t i = 0; i < n; i++) face_ns[first + i] += share;
+        }
+        memcpy(&orientations[first], batch->results, n * sizeof(VAALEuler));
+        if (!m) return VAAL_SUCCESS;
+
+        if (buffer_bind(batch, 1 - k)) return VAAL_ERROR_INTERNAL;
+        k       = 1 - k;
+        load_ns = next_load;
+        worker_submit(worker);
+
+        first = next;
+        n     = m;
+    }
+}
+
+VAALError
+pose_batch_run(PoseBatch*   batch,
+               const Frame* frame,
+               const char*  path,
+               int32_t      (*rois)[4],
+               size_t       count,
+               VAALEuler*   orientations,
+               PoseTiming*  timing)
+{
+    // Overlapping only pays off with a second chunk, and only CPU crops may
+    // be loaded while the context runs the model.
+    if (batch->worker && batch->preprocess && frame &&
+        count > (size_t) batch->batch) {
+        return run_async(batch, frame, rois, count, orientations, timing);
+    }
+    return run_serial(batch,
+                      frame,
+                      path,
+                      rois,
+                      count,
+                      orientations,
+                      timing);
+}
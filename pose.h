@@ -0,0 +1,123 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "preprocess.h"
+#include "vaal.h"
+
+typedef struct PoseWorker PoseWorker;
+
+/**
+ * Runs the head pose model over every face of a frame in as few invocations
+ * as the model allows.  When the model input has a batch dimension larger
+ * than one each face crop is resized into its own slot of the NHWC input
+ * tensor and a single vaal_run_model() covers up to that many faces,
+ * otherwise the faces are run one at a time.
+ */
+typedef struct {
+    VAALContext* ctx;        // Head pose context owning the input tensor
+    NNTensor*    input;      // Input tensor of ctx
+    int32_t      batch;      // Number of faces covered by one inference
+    int32_t      num_slots;  // Number of views in slots
+    NNTensor**   slots;      // Views onto each batch element of input
+    VAALEuler*   results;    // Scratch for the batch decoded by vaal_euler
+    Preprocess*  preprocess; // Loads crops of RGB frames, NULL to use VAAL
+    // The two buffers input is bound to in turn, the next chunk of faces
+    // being loaded into one while the model reads the other, each with its
+    // own views.  NULL unless pose_batch_async() was called.
+    NNTensor*    buffers[2];
+    NNTensor**   buffer_slots[2];
+    int          bound;      // Buffer input is bound to and mapped, or -1
+    PoseWorker*  worker;     // Thread running the model or NULL
+} PoseBatch;
+
+/**
+ * Time spent in each step of pose_batch_run(), accumulated over all faces.
+ */
+typedef struct {
+    int64_t  load_ns;      // Loading every crop into the input tensor
+    int64_t  inference_ns; // Every vaal_run_model()
+    int64_t  euler_ns;     // Every vaal_euler()
+    int64_t* face_ns;      // Per face, its load plus a share of its batch
+} PoseTiming;
+
+/**
+ * Prepares batch for the model already loaded into ctx.
+ *
+ * Returns 0 on success or -1 if the input tensor could not be partitioned.
+ */
+int
+pose_batch_init(PoseBatch* batch, VAALContext* ctx);
+
+/**
+ * Loads the crops of RGB frames into the input with kernel instead of VAAL,
+ * normalized by the VAAL_IMAGE_PROC_* flags of norm.  PREPROCESS_VAAL keeps
+ * VAAL loading every crop.
+ *
+ * Returns 0 on success or -1 with errno set to ENOTSUP when kernel does not
+ * handle the input tensor of the model, which keeps VAAL, or to ENOMEM.
+ */
+int
+pose_batch_preprocess(PoseBatch* batch, PreprocessKernel kernel, int norm);
+
+/**
+ * Runs the model on a thread of its own so that, when the faces of a frame
+ * take more than one inference and batch->preprocess loads their crops, the
+ * crops of the next inference are loaded while the current one runs.  The
+ * input tensor is bound to two buffers in turn with nn_tensor_assign(), the
+ * crops going into the one the model is not reading, so handing a chunk
+ * over to the model copies nothing.  The bound buffer stays mapped since
+ * the input points into its mapping.
+ *
+ * Returns 0 on success or -1 when the buffers could not be allocated or
+ * bound or the thread could not be created, in which case pose_batch_run()
+ * stays synchronous.
+ */
+int
+pose_batch_async(PoseBatch* batch);
+
+/**
+ * Releases the resources held by batch, the context is not released.
+ */
+void
+pose_batch_release(PoseBatch* batch);
+
+/**
+ * Estimates the orientation of count faces given by rois, each xmin, ymin,
+ * xmax, ymax in pixels, and stores them in orientations.  Crops are taken
+ * from frame when provided, by batch->preprocess when set and the frame is
+ * RGB, otherwise they are loaded from the image file at path.  The time
+ * spent in each step is added to timing when not NULL, timing->face_ns is
+ * overwritten for the count faces when not NULL.
+ */
+VAALError
+pose_batch_run(PoseBatch*   batch,
+               const Frame* frame,
+               const char*  path,
+               int32_t      (*rois)[4],
+               size_t       count,
+               VAALEuler*   orientations,
+               PoseTiming*  timing);
+
+#endif /* POSE_H */
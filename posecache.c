@@ -0,0 +1,115 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "posecache.h"
+
+static PoseCacheEntry*
+pose_cache_find(PoseCache* cache, uint32_t id)
+{
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].id == id) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+int
+pose_cache_init(PoseCache* cache, size_t max_faces, int threshold, int ttl)
+{
+    memset(cache, 0, sizeof(*cache));
+    // Faces lost for a few frames keep their entry like their track.
+    cache->capacity  = max_faces * 2;
+    cache->threshold = threshold;
+    cache->ttl       = MAX(ttl, 1);
+    cache->entries   = calloc(cache->capacity, sizeof(PoseCacheEntry));
+    cache->rois      = calloc(max_faces, sizeof(*cache->rois));
+    cache->faces     = calloc(max_faces, sizeof(size_t));
+    cache->results   = calloc(max_faces, sizeof(VAALEuler));
+    cache->face_ns   = calloc(max_faces, sizeof(int64_t));
+    cache->thumbs    = calloc(max_faces, sizeof(*cache->thumbs));
+    cache->has_thumb = calloc(max_faces, sizeof(bool));
+
+    if (!cache->entries || !cache->rois || !cache->faces || !cache->results ||
+        !cache->face_ns || !cache->thumbs || !cache->has_thumb) {
+        pose_cache_release(cache);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+pose_cache_release(PoseCache* cache)
+{
+    free(cache->entries);
+    free(cache->rois);
+    free(cache->faces);
+    free(cache->results);
+    free(cache->face_ns);
+    free(cache->thumbs);
+    free(cache->has_thumb);
+    memset(cache, 0, sizeof(*cache));
+}
+
+bool
+pose_cache_lookup(PoseCache*     cache,
+                  uint32_t       id,
+                  const uint8_t* thumb,
+                  VAALEuler*     euler)
+{
+    PoseCacheEntry* entry = pose_cache_find(cache, id);
+    if (!entry || entry->uses + 1 >= cache->ttl) return false;
+
+    int sad = 0;
+    for (int i = 0; i < FRAME_THUMB_SIZE; i++) {
+        sad += abs((int) thumb[i] - (int) entry->thumb[i]);
+    }
+    if (sad > cache->threshold * FRAME_THUMB_SIZE) return false;
+
+    entry->uses++;
+    entry->frame = cache->frame;
+    *euler       = entry->euler;
+    return true;
+}
+
+void
+pose_cache_store(PoseCache*       cache,
+                 uint32_t         id,
+                 const uint8_t*   thumb,
+                 const VAALEuler* euler)
+{
+    PoseCacheEntry* entry = pose_cache_find(cache, id);
+
+    if (!entry) {
+        // Free entries have id 0 and frame 0 so they are taken first.
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->capacity; i++) {
+            if (cache->entries[i].frame < entry->frame) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+
+    entry->id    = id;
+    entry->uses  = 0;
+    entry->frame = cache->frame;
+    entry->euler = *euler;
+    memcpy(entry->thumb, thumb, FRAME_THUMB_SIZE);
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef POSECACHE_H
+#define POSECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "vaal.h"
+
+/**
+ * A pose estimated for a tracked face together with the thumbnail of the
+ * crop it was estimated from.
+ */
+typedef struct {
+    uint32_t  id;                     // Track of the face, 0 for a free entry
+    uint8_t   thumb[FRAME_THUMB_SIZE];
+    VAALEuler euler;
+    int       uses;                   // Times reused since it was estimated
+    uint64_t  frame;                  // Frame the entry was last used on
+} PoseCacheEntry;
+
+/**
+ * Remembers the head pose of every tracked face so it can be reused while
+ * the face crop stays the same.  A crop is considered unchanged when the
+ * mean absolute difference of its grey thumbnail from the cached one is at
+ * most threshold, on a 0 to 255 scale, and the pose is estimated again at
+ * least every ttl frames regardless.
+ */
+typedef struct {
+    PoseCacheEntry* entries;
+    size_t          capacity;
+    int             threshold;
+    int             ttl;
+    uint64_t        frame;       // Frames seen, to evict the oldest entry
+    int32_t         (*rois)[4];  // Crops still needing inference
+    size_t*         faces;       // Face of the job behind each of rois
+    VAALEuler*      results;     // Orientations estimated for rois
+    int64_t*        face_ns;     // Timing of each of rois
+    uint8_t         (*thumbs)[FRAME_THUMB_SIZE]; // Thumbnail of each of rois
+    bool*           has_thumb;   // Whether thumbs holds a thumbnail
+} PoseCache;
+
+/**
+ * Prepares cache for up to max_faces faces per frame.
+ *
+ * Returns 0 on success or -1 when out of memory.
+ */
+int
+pose_cache_init(PoseCache* cache, size_t max_faces, int threshold, int ttl);
+
+/**
+ * Releases the entries held by cache.
+ */
+void
+pose_cache_release(PoseCache* cache);
+
+/**
+ * Looks up the pose of track id, stored into euler when its thumbnail still
+ * matches thumb and it has not outlived the TTL.
+ *
+ * Returns true when euler was filled from the cache.
+ */
+bool
+pose_cache_lookup(PoseCache*     cache,
+                  uint32_t       id,
+                  const uint8_t* thumb,
+                  VAALEuler*     euler);
+
+/**
+ * Stores the freshly estimated pose of track id and its thumbnail, evicting
+ * the entry unused for longest when full.
+ */
+void
+pose_cache_store(PoseCache*       cache,
+                 uint32_t         id,
+                 const uint8_t*   thumb,
+                 const VAALEuler* euler);
+
+#endif /* POSECACHE_H */
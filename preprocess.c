@@ -0,0 +1,912 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "preprocess.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PREPROCESS_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PREPROCESS_ARM 1
+#endif
+
+static const char* kernel_names[] = {
+    [PREPROCESS_VAAL]   = "vaal",
+    [PREPROCESS_AUTO]   = "auto",
+    [PREPROCESS_SCALAR] = "scalar",
+    [PREPROCESS_SSE2]   = "sse2",
+    [PREPROCESS_AVX2]   = "avx2",
+    [PREPROCESS_NEON]   = "neon",
+};
+
+// ImageNet channel statistics on the 0-255 scale.
+static const float imagenet_mean[3] = {0.485f * 255, 0.456f * 255, 0.406f * 255};
+static const float imagenet_std[3]  = {0.229f * 255, 0.224f * 255, 0.225f * 255};
+
+// The normalizations of the interpolated value v of channel c.  Every
+// expansion has a constant c so the ImageNet statistics fold into the code.
+#define NORM_RAW(v, c) (v)
+#define NORM_UNSIGNED(v, c) ((v) * (1.0f / 255.0f))
+#define NORM_SIGNED(v, c) ((v) * (1.0f / 127.5f) - 1.0f)
+#define NORM_IMAGENET(v, c) (((v) - imagenet_mean[c]) * (1.0f / imagenet_std[c]))
+
+// Position of channel c of pixel x within a tensor row.
+#define INDEX_NHWC(x, c, plane) ((x) * 3 + (c))
+#define INDEX_NCHW(x, c, plane) ((c) * (plane) + (x))
+
+#define ROW_CHANNEL(norm, layout, c)                             \
+    dst[INDEX_##layout(x, c, plane)] =                           \
+        NORM_##norm(a[x * 3 + c] + (b[x * 3 + c] - a[x * 3 + c]) * wy, c)
+
+#define DEFINE_ROW(norm, layout)                              \
+    static void row_##norm##_##layout(const float* a,         \
+                                      const float* b,         \
+                                      float        wy,        \
+                                      void*        row,       \
+                                      int32_t      width,     \
+                                      size_t       plane)     \
+    {                                                         \
+        float* dst = row;                                     \
+        (void) plane;                                         \
+        for (int32_t x = 0; x < width; x++) {                 \
+            ROW_CHANNEL(norm, layout, 0);                     \
+            ROW_CHANNEL(norm, layout, 1);                     \
+            ROW_CHANNEL(norm, layout, 2);                     \
+        }                                                     \
+    }
+
+#define DEFINE_ROWS(norm)     \
+    DEFINE_ROW(norm, NHWC)    \
+    DEFINE_ROW(norm, NCHW)
+
+DEFINE_ROWS(RAW)
+DEFINE_ROWS(UNSIGNED)
+DEFINE_ROWS(SIGNED)
+DEFINE_ROWS(IMAGENET)
+
+enum { ROW_RAW, ROW_UNSIGNED, ROW_SIGNED, ROW_IMAGENET, ROW_NORMS };
+enum { ROW_F32, ROW_U8, ROW_I8 };
+
+#define ROW_ENTRY(norm) [ROW_##norm] = {row_##norm##_NHWC, row_##norm##_NCHW}
+
+// Indexed by normalization and whether the tensor is planar, F32 only since
+// integer tensors go through the quantize functions below.
+static const PreprocessRow row_functions[ROW_NORMS][2] = {
+    ROW_ENTRY(RAW),
+    ROW_ENTRY(UNSIGNED),
+    ROW_ENTRY(SIGNED),
+    ROW_ENTRY(IMAGENET),
+};
+
+static void
+blend_scalar(const float* a,
+             const float* b,
+             float        wy,
+             const float* scale,
+             const float* bias,
+             float*       out,
+             size_t       n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (a[i] + (b[i] - a[i]) * wy) * scale[i] + bias[i];
+    }
+}
+
+#ifdef PREPROCESS_X86
+static void
+blend_sse2(const float* a,
+           const float* b,
+           float        wy,
+           const float* scale,
+           const float* bias,
+           float*       out,
+           size_t       n)
+{
+    __m128 w = _mm_set1_ps(wy);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        __m128 v  = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), w));
+        v         = _mm_add_ps(_mm_mul_ps(v, _mm_loadu_ps(scale + i)),
+                       _mm_loadu_ps(bias + i));
+        _mm_storeu_ps(out + i, v);
+    }
+
+    blend_scalar(a + i, b + i, wy, scale + i, bias + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void
+blend_avx2(const float* a,
+           const float* b,
+           float        wy,
+           const float* scale,
+           const float* bias,
+           float*       out,
+           size_t       n)
+{
+    __m256 w = _mm256_set1_ps(wy);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        __m256 v  = _mm256_fmadd_ps(_mm256_sub_ps(vb, va), w, va);
+        v         = _mm256_fmadd_ps(v,
+                            _mm256_loadu_ps(scale + i),
+                            _mm256_loadu_ps(bias + i));
+        _mm256_storeu_ps(out + i, v);
+    }
+
+    blend_scalar(a + i, b + i, wy, scale + i, bias + i, out + i, n - i);
+}
+#endif
+
+#ifdef PREPROCESS_ARM
+static void
+blend_neon(const float* a,
+           const float* b,
+           float        wy,
+           const float* scale,
+           const float* bias,
+           float*       out,
+           size_t       n)
+{
+    float32x4_t w = vdupq_n_f32(wy);
+    size_t      i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t va = vld1q_f32(a + i);
+        float32x4_t vb = vld1q_f32(b + i);
+#ifdef __aarch64__
+        float32x4_t v = vfmaq_f32(va, vsubq_f32(vb, va), w);
+        v             = vfmaq_f32(vld1q_f32(bias + i), v, vld1q_f32(scale + i));
+#else
+        float32x4_t v = vmlaq_f32(va, vsubq_f32(vb, va), w);
+        v             = vmlaq_f32(vld1q_f32(bias + i), v, vld1q_f32(scale + i));
+#endif
+        vst1q_f32(out + i, v);
+    }
+
+    blend_scalar(a + i, b + i, wy, scale + i, bias + i, out + i, n - i);
+}
+#endif
+
+static PreprocessBlend
+blend_row(PreprocessKernel kernel)
+{
+    switch (kernel) {
+#ifdef PREPROCESS_X86
+    case PREPROCESS_SSE2:
+        return blend_sse2;
+    case PREPROCESS_AVX2:
+        return blend_avx2;
+#endif
+#ifdef PREPROCESS_ARM
+    case PREPROCESS_NEON:
+        return blend_neon;
+#endif
+    default:
+        return blend_scalar;
+    }
+}
+
+// Pixels the SIMD quantize functions blend before looking them up.
+#define QUANTIZE_BLOCK 16
+
+// Rounds the n fixed point values of rows a and b, b weighted by wy of 256,
+// to the levels at out.
+static void
+levels_scalar(const uint16_t* a,
+              const uint16_t* b,
+              uint32_t        wy,
+              uint8_t*        out,
+              size_t          n)
+{
+    uint32_t wx = 256 - wy;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (uint8_t) ((a[i] * wx + b[i] * wy + (1u << 15)) >> 16);
+    }
+}
+
+// Channel c of pixel x at dst mapped through the lookup table of c.
+#define LOOKUP_CHANNEL(layout, x, c, level) \
+    dst[INDEX_##layout(x, c, plane)] = lut[(c) * 256 + (level)]
+
+#define DEFINE_QUANTIZE_SCALAR(layout)                                   \
+    static void quantize_scalar_##layout(const uint8_t*  lut,            \
+                                         const uint16_t* a,              \
+                                         const uint16_t* b,              \
+                                         uint32_t        wy,             \
+                                         uint8_t*        dst,            \
+                                         int32_t         width,          \
+                                         size_t          plane)          \
+    {                                                                    \
+        uint32_t wx = 256 - wy;                                          \
+        (void) plane;                                                    \
+        for (int32_t x = 0; x < width; x++) {                            \
+            for (int c = 0; c < 3; c++) {                                \
+                uint32_t i = (uint32_t) x * 3 + c;                       \
+                LOOKUP_CHANNEL(layout,                                   \
+                               x,                                        \
+                               c,                                        \
+                               (a[i] * wx + b[i] * wy + (1u << 15)) >> 16); \
+            }                                                            \
+        }                                                                \
+    }
+
+DEFINE_QUANTIZE_SCALAR(NHWC)
+DEFINE_QUANTIZE_SCALAR(NCHW)
+
+// Blends QUANTIZE_BLOCK pixels at a time with levels_##isa() and looks them
+// up one by one, the pixels left over by the scalar version.
+#define DEFINE_QUANTIZE(isa, layout, attr)                                  \
+    attr static void quantize_##isa##_##layout(const uint8_t*  lut,         \
+                                               const uint16_t* a,           \
+                                               const uint16_t* b,           \
+                                               uint32_t        wy,          \
+                                               uint8_t*        dst,         \
+                                               int32_t         width,       \
+                                               size_t          plane)       \
+    {                                                                       \
+        uint8_t levels[QUANTIZE_BLOCK * 3];                                 \
+        int32_t x = 0;                                                      \
+        for (; x + QUANTIZE_BLOCK <= width; x += QUANTIZE_BLOCK) {          \
+            levels_##isa(a + x * 3, b + x * 3, wy, levels, sizeof(levels)); \
+            for (int32_t k = 0; k < QUANTIZE_BLOCK; k++) {                  \
+                LOOKUP_CHANNEL(layout, x + k, 0, levels[k * 3]);            \
+                LOOKUP_CHANNEL(layout, x + k, 1, levels[k * 3 + 1]);        \
+                LOOKUP_CHANNEL(layout, x + k, 2, levels[k * 3 + 2]);        \
+            }                                                               \
+        }                                                                   \
+        quantize_scalar_##layout(lut,                                       \
+                                 a + x * 3,                                 \
+                                 b + x * 3,                                 \
+                                 wy,                                        \
+                                 dst + INDEX_##layout(x, 0, plane),         \
+                                 width - x,                                 \
+                                 plane);                                    \
+    }
+
+#ifdef PREPROCESS_X86
+// The levels of the 8 fixed point values at a and b as 16 bit lanes, from
+// the full 32 bit products since SSE2 only multiplies 16 bit lanes.
+static inline __m128i
+level8_sse2(const uint16_t* a,
+            const uint16_t* b,
+            __m128i         wx,
+            __m128i         wy,
+            __m128i         round)
+{
+    __m128i va   = _mm_loadu_si128((const __m128i*) a);
+    __m128i vb   = _mm_loadu_si128((const __m128i*) b);
+    __m128i a_lo = _mm_mullo_epi16(va, wx);
+    __m128i a_hi = _mm_mulhi_epu16(va, wx);
+    __m128i b_lo = _mm_mullo_epi16(vb, wy);
+    __m128i b_hi = _mm_mulhi_epu16(vb, wy);
+    __m128i s0   = _mm_add_epi32(_mm_unpacklo_epi16(a_lo, a_hi),
+                               _mm_unpacklo_epi16(b_lo, b_hi));
+    __m128i s1   = _mm_add_epi32(_mm_unpackhi_epi16(a_lo, a_hi),
+                               _mm_unpackhi_epi16(b_lo, b_hi));
+    s0           = _mm_srli_epi32(_mm_add_epi32(s0, round), 16);
+    s1           = _mm_srli_epi32(_mm_add_epi32(s1, round), 16);
+    return _mm_packs_epi32(s0, s1);
+}
+
+static void
+levels_sse2(const uint16_t* a,
+            const uint16_t* b,
+            uint32_t        wy,
+            uint8_t*        out,
+            size_t          n)
+{
+    __m128i wx    = _mm_set1_epi16((short) (256 - wy));
+    __m128i wb    = _mm_set1_epi16((short) wy);
+    __m128i round = _mm_set1_epi32(1 << 15);
+    size_t  i     = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = level8_sse2(a + i, b + i, wx, wb, round);
+        __m128i hi = level8_sse2(a + i + 8, b + i + 8, wx, wb, round);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(lo, hi));
+    }
+
+    levels_scalar(a + i, b + i, wy, out + i, n - i);
+}
+
+// Like level8_sse2() for 16 values, the packs keeping them in order since
+// the unpacks and packs both work within 128 bit lanes.
+__attribute__((target("avx2"))) static inline __m256i
+level16_avx2(const uint16_t* a,
+             const uint16_t* b,
+             __m256i         wx,
+             __m256i         wy,
+             __m256i         round)
+{
+    __m256i va   = _mm256_loadu_si256((const __m256i*) a);
+    __m256i vb   = _mm256_loadu_si256((const __m256i*) b);
+    __m256i a_lo = _mm256_mullo_epi16(va, wx);
+    __m256i a_hi = _mm256_mulhi_epu16(va, wx);
+    __m256i b_lo = _mm256_mullo_epi16(vb, wy);
+    __m256i b_hi = _mm256_mulhi_epu16(vb, wy);
+    __m256i s0   = _mm256_add_epi32(_mm256_unpacklo_epi16(a_lo, a_hi),
+                                  _mm256_unpacklo_epi16(b_lo, b_hi));
+    __m256i s1   = _mm256_add_epi32(_mm256_unpackhi_epi16(a_lo, a_hi),
+                                  _mm256_unpackhi_epi16(b_lo, b_hi));
+    s0           = _mm256_srli_epi32(_mm256_add_epi32(s0, round), 16);
+    s1           = _mm256_srli_epi32(_mm256_add_epi32(s1, round), 16);
+    return _mm256_packs_epi32(s0, s1);
+}
+
+__attribute__((target("avx2"))) static void
+levels_avx2(const uint16_t* a,
+            const uint16_t* b,
+            uint32_t        wy,
+            uint8_t*        out,
+            size_t          n)
+{
+    __m256i wx    = _mm256_set1_epi16((short) (256 - wy));
+    __m256i wb    = _mm256_set1_epi16((short) wy);
+    __m256i round = _mm256_set1_epi32(1 << 15);
+    size_t  i     = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = level16_avx2(a + i, b + i, wx, wb, round);
+        __m256i hi = level16_avx2(a + i + 16, b + i + 16, wx, wb, round);
+        // packus interleaves the 64 bit quarters of lo and hi.
+        __m256i v  = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*) (out + i), v);
+    }
+    // Staying in AVX2 avoids the transition penalty of calling SSE2 code.
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = level16_avx2(a + i, b + i, wx, wb, round);
+        _mm_storeu_si128((__m128i*) (out + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(v),
+                                          _mm256_extracti128_si256(v, 1)));
+    }
+
+    levels_scalar(a + i, b + i, wy, out + i, n - i);
+}
+
+// Neither SSE2 nor AVX2 can look up bytes in a 256 entry table faster than
+// scalar loads, only the blend is vectorized.
+DEFINE_QUANTIZE(sse2, NHWC, )
+DEFINE_QUANTIZE(sse2, NCHW, )
+DEFINE_QUANTIZE(avx2, NHWC, __attribute__((target("avx2"))))
+DEFINE_QUANTIZE(avx2, NCHW, __attribute__((target("avx2"))))
+#endif
+
+#ifdef PREPROCESS_ARM
+static void
+levels_neon(const uint16_t* a,
+            const uint16_t* b,
+            uint32_t        wy,
+            uint8_t*        out,
+            size_t          n)
+{
+    uint16x4_t wx = vdup_n_u16((uint16_t) (256 - wy));
+    uint16x4_t wb = vdup_n_u16((uint16_t) wy);
+    size_t     i  = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t va = vld1q_u16(a + i);
+        uint16x8_t vb = vld1q_u16(b + i);
+        uint32x4_t lo = vmlal_u16(vmull_u16(vget_low_u16(va), wx),
+                                  vget_low_u16(vb),
+                                  wb);
+        uint32x4_t hi = vmlal_u16(vmull_u16(vget_high_u16(va), wx),
+                                  vget_high_u16(vb),
+                                  wb);
+        // The rounding narrowing shift adds the 1 << 15 of the scalar path.
+        uint16x8_t v  = vcombine_u16(vrshrn_n_u32(lo, 16),
+                                     vrshrn_n_u32(hi, 16));
+        vst1_u8(out + i, vmovn_u16(v));
+    }
+
+    levels_scalar(a + i, b + i, wy, out + i, n - i);
+}
+
+#ifdef __aarch64__
+// Maps every byte of idx through the 256 entry table held in four quarters,
+// indices past a quarter keeping the previous result.
+static inline uint8x16_t
+lookup_neon(const uint8x16x4_t table[4], uint8x16_t idx)
+{
+    uint8x16_t quarter = vdupq_n_u8(64);
+    uint8x16_t v       = vqtbl4q_u8(table[0], idx);
+    idx                = vsubq_u8(idx, quarter);
+    v                  = vqtbx4q_u8(v, table[1], idx);
+    idx                = vsubq_u8(idx, quarter);
+    v                  = vqtbx4q_u8(v, table[2], idx);
+    idx                = vsubq_u8(idx, quarter);
+    return vqtbx4q_u8(v, table[3], idx);
+}
+
+#define STORE_NEON_NHWC(dst, v, plane) vst3q_u8(dst, v)
+#define STORE_NEON_NCHW(dst, v, plane)            \
+    do {                                          \
+        vst1q_u8(dst, (v).val[0]);                \
+        vst1q_u8((dst) + (plane), (v).val[1]);    \
+        vst1q_u8((dst) + (plane) * 2, (v).val[2]); \
+    } while (0)
+
+// Looks up QUANTIZE_BLOCK pixels at a time with table instructions on the
+// channels split apart by vld3q_u8().
+#define DEFINE_QUANTIZE_NEON(layout)                                        \
+    static void quantize_neon_##layout(const uint8_t*  lut,                 \
+                                       const uint16_t* a,                   \
+                                       const uint16_t* b,                   \
+                                       uint32_t        wy,                  \
+                                       uint8_t*        dst,                 \
+                                       int32_t         width,               \
+                                       size_t          plane)               \
+    {                                                                       \
+        uint8x16x4_t table[3][4];                                           \
+        for (int c = 0; c < 3; c++) {                                       \
+            for (int q = 0; q < 4; q++) {                                   \
+                const uint8_t* t    = lut + c * 256 + q * 64;               \
+                table[c][q].val[0] = vld1q_u8(t);                           \
+                table[c][q].val[1] = vld1q_u8(t + 16);                      \
+                table[c][q].val[2] = vld1q_u8(t + 32);                      \
+                table[c][q].val[3] = vld1q_u8(t + 48);                      \
+            }                                                               \
+        }                                                                   \
+                                                                            \
+        uint8_t levels[QUANTIZE_BLOCK * 3];                                 \
+        int32_t x = 0;                                                      \
+        for (; x + QUANTIZE_BLOCK <= width; x += QUANTIZE_BLOCK) {          \
+            levels_neon(a + x * 3, b + x * 3, wy, levels, sizeof(levels));  \
+            uint8x16x3_t v = vld3q_u8(levels);                              \
+            v.val[0]       = lookup_neon(table[0], v.val[0]);               \
+            v.val[1]       = lookup_neon(table[1], v.val[1]);               \
+            v.val[2]       = lookup_neon(table[2], v.val[2]);               \
+            STORE_NEON_##layout(dst + INDEX_##layout(x, 0, plane), v, plane); \
+        }                                                                   \
+        quantize_scalar_##layout(lut,                                       \
+                                 a + x * 3,                                 \
+                                 b + x * 3,                                 \
+                                 wy,                                        \
+                                 dst + INDEX_##layout(x, 0, plane),         \
+                                 width - x,                                 \
+                                 plane);                                    \
+    }
+
+DEFINE_QUANTIZE_NEON(NHWC)
+DEFINE_QUANTIZE_NEON(NCHW)
+#else
+// 32 bit ARM lacks the four register table lookups, only the blend is
+// vectorized.
+DEFINE_QUANTIZE(neon, NHWC, )
+DEFINE_QUANTIZE(neon, NCHW, )
+#endif
+#endif
+
+static PreprocessQuantize
+quantize_row(PreprocessKernel kernel, bool planar)
+{
+    switch (kernel) {
+#ifdef PREPROCESS_X86
+    case PREPROCESS_SSE2:
+        return planar ? quantize_sse2_NCHW : quantize_sse2_NHWC;
+    case PREPROCESS_AVX2:
+        return planar ? quantize_avx2_NCHW : quantize_avx2_NHWC;
+#endif
+#ifdef PREPROCESS_ARM
+    case PREPROCESS_NEON:
+        return planar ? quantize_neon_NCHW : quantize_neon_NHWC;
+#endif
+    default:
+        return planar ? quantize_scalar_NCHW : quantize_scalar_NHWC;
+    }
+}
+
+int
+preprocess_parse(const char* name, PreprocessKernel* kernel)
+{
+    for (size_t i = 0; i < sizeof(kernel_names) / sizeof(*kernel_names); i++) {
+        if (strcmp(name, kernel_names[i]) == 0) {
+            *kernel = (PreprocessKernel) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char*
+preprocess_name(PreprocessKernel kernel)
+{
+    return kernel_names[kernel];
+}
+
+int
+preprocess_select(PreprocessKernel kernel)
+{
+    switch (kernel) {
+    case PREPROCESS_AUTO:
+#if defined(PREPROCESS_X86)
+        if (preprocess_select(PREPROCESS_AVX2) >= 0) return PREPROCESS_AVX2;
+        return PREPROCESS_SSE2;
+#elif defined(PREPROCESS_ARM)
+        return PREPROCESS_NEON;
+#else
+        return PREPROCESS_SCALAR;
+#endif
+    case PREPROCESS_SSE2:
+#ifdef PREPROCESS_X86
+        return kernel;
+#else
+        return -1;
+#endif
+    case PREPROCESS_AVX2:
+#ifdef PREPROCESS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return kernel;
+        }
+#endif
+        return -1;
+    case PREPROCESS_NEON:
+#ifdef PREPROCESS_ARM
+        return kernel;
+#else
+        return -1;
+#endif
+    default:
+        return kernel;
+    }
+}
+
+int
+preprocess_init(Preprocess*      pre,
+                PreprocessKernel kernel,
+                NNTensor*        tensor,
+                int              norm)
+{
+    memset(pre, 0, sizeof(*pre));
+
+    const int32_t* shape = nn_tensor_shape(tensor);
+    int            norm_index, type_index;
+
+    switch (norm) {
+    case 0:
+    case VAAL_IMAGE_PROC_WHITENING:
+        // Whitening is applied once the whole crop has been seen.
+        norm_index = ROW_RAW;
+        break;
+    case VAAL_IMAGE_PROC_UNSIGNED_NORM:
+        norm_index = ROW_UNSIGNED;
+        break;
+    case VAAL_IMAGE_PROC_SIGNED_NORM:
+        norm_index = ROW_SIGNED;
+        break;
+    case VAAL_IMAGE_PROC_IMAGENET:
+        norm_index = ROW_IMAGENET;
+        break;
+    default:
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    switch (nn_tensor_type(tensor)) {
+    case NNTensorType_F32:
+        type_index = ROW_F32;
+        break;
+    case NNTensorType_U8:
+        type_index = ROW_U8;
+        break;
+    case NNTensorType_I8:
+        type_index = ROW_I8;
+        break;
+    default:
+        type_index = -1;
+        break;
+    }
+
+    if (kernel == PREPROCESS_VAAL || kernel == PREPROCESS_AUTO ||
+        nn_tensor_dims(tensor) != 4 || shape[0] != 1 || type_index < 0 ||
+        (type_index != ROW_F32 && norm == VAAL_IMAGE_PROC_WHITENING)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    // Normalized values only fit integer tensors through their quantization.
+    size_t         num_scales = 0, num_zeros = 0;
+    const float*   scales     = NULL;
+    const int32_t* zeros      = NULL;
+    if (type_index != ROW_F32 && norm_index != ROW_RAW) {
+        scales = nn_tensor_scales(tensor, &num_scales);
+        zeros  = nn_tensor_zeros(tensor, &num_zeros);
+        if (!scales || !num_scales) {
+            errno = ENOTSUP;
+            return -1;
+        }
+    }
+
+    if (shape[3] == 3) {
+        pre->height = shape[1];
+        pre->width  = shape[2];
+    } else if (shape[1] == 3) {
+        pre->planar = true;
+        pre->height = shape[2];
+        pre->width  = shape[3];
+    } else {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    pre->kernel    = kernel;
+    pre->norm      = norm;
+    pre->element   = nn_tensor_element_size(tensor);
+    pre->row_y[0]  = -1;
+    pre->row_y[1]  = -1;
+
+    // SIMD kernels normalize whole rows against the tables below and leave
+    // only the conversion to the tensor layout to the row function.
+    if (type_index != ROW_F32) {
+        pre->quantize = quantize_row(kernel, pre->planar);
+    } else if (kernel == PREPROCESS_SCALAR) {
+        pre->row = row_functions[norm_index][pre->planar];
+    } else {
+        pre->blend = blend_row(kernel);
+        pre->row   = row_functions[ROW_RAW][pre->planar];
+    }
+
+    size_t width = (size_t) pre->width;
+    size_t row   = width * 3 * sizeof(float);
+    size_t fixed = width * 3 * sizeof(uint16_t);
+    if (arena_init(&pre->arena,
+                   arena_size(width * sizeof(int32_t)) * 2 +
+                       arena_size(width * sizeof(float)) +
+                       arena_size(row) * 5 +
+                       arena_size(width * sizeof(uint16_t)) +
+                       arena_size(fixed) * 2 + arena_size(3 * 256))) {
+        return -1;
+    }
+    pre->x_left   = arena_alloc(&pre->arena, width * sizeof(int32_t));
+    pre->x_right  = arena_alloc(&pre->arena, width * sizeof(int32_t));
+    pre->x_weight = arena_alloc(&pre->arena, width * sizeof(float));
+    pre->rows[0]  = arena_alloc(&pre->arena, row);
+    pre->rows[1]  = arena_alloc(&pre->arena, row);
+    pre->scale    = arena_alloc(&pre->arena, row);
+    pre->bias     = arena_alloc(&pre->arena, row);
+    pre->out      = arena_alloc(&pre->arena, row);
+    pre->x_fixed  = arena_alloc(&pre->arena, width * sizeof(uint16_t));
+    pre->fixed[0] = arena_alloc(&pre->arena, fixed);
+    pre->fixed[1] = arena_alloc(&pre->arena, fixed);
+    pre->lut      = arena_alloc(&pre->arena, 3 * 256);
+
+    for (size_t i = 0; i < width * 3; i++) {
+        size_t c = i % 3;
+        switch (norm_index) {
+        case ROW_UNSIGNED:
+            pre->scale[i] = 1.0f / 255.0f;
+            pre->bias[i]  = 0.0f;
+            break;
+        case ROW_SIGNED:
+            pre->scale[i] = 1.0f / 127.5f;
+            pre->bias[i]  = -1.0f;
+            break;
+        case ROW_IMAGENET:
+            pre->scale[i] = 1.0f / imagenet_std[c];
+            pre->bias[i]  = -imagenet_mean[c] / imagenet_std[c];
+            break;
+        default:
+            pre->scale[i] = 1.0f;
+            pre->bias[i]  = 0.0f;
+            break;
+        }
+    }
+
+    // Levels of raw crops are stored as is, signed tensors shifted by 128.
+    // Normalized levels are quantized with the per channel parameters when
+    // the tensor has three, otherwise with the first.
+    for (int c = 0; c < 3; c++) {
+        float   scale = scales ? scales[num_scales == 3 ? c : 0] : 1.0f;
+        int32_t zero  = num_zeros ? zeros[num_zeros == 3 ? c : 0] : 0;
+        int32_t lo    = type_index == ROW_I8 ? -128 : 0;
+
+        for (int v = 0; v < 256; v++) {
+            int32_t q = v + lo;
+            if (norm_index != ROW_RAW) {
+                float x = v * pre->scale[c] + pre->bias[c];
+                q       = (int32_t) lrintf(x / scale) + zero;
+            }
+            pre->lut[c * 256 + v] = (uint8_t) CLAMP(q, lo, lo + 255);
+        }
+    }
+
+    return 0;
+}
+
+void
+preprocess_release(Preprocess* pre)
+{
+    arena_release(&pre->arena);
+    memset(pre, 0, sizeof(*pre));
+}
+
+// Maps output pixel i of dim onto the source span [lo, hi) with the pixel
+// centres aligned, clamped so both neighbours stay inside the span.
+static float
+source_coord(int32_t i, int32_t lo, int32_t hi, int32_t dim)
+{
+    float s = lo + (i + 0.5f) * (float) (hi - lo) / (float) dim - 0.5f;
+    return CLAMP(s, (float) lo, (float) (hi - 1));
+}
+
+// Interpolates source row y horizontally to the tensor width, reusing the
+// result when the previous output row already needed it.  Consecutive rows
+// land in different buffers so both neighbours of a row are kept.
+static const float*
+source_row(Preprocess* pre, const Frame* frame, int32_t y)
+{
+    float* dst = pre->rows[y & 1];
+    if (pre->row_y[y & 1] == y) return dst;
+    pre->row_y[y & 1] = y;
+
+    const uint8_t* src = frame->data + (size_t) y * frame->width * 3;
+    for (int32_t x = 0; x < pre->width; x++) {
+        const uint8_t* l = src + pre->x_left[x];
+        const uint8_t* r = src + pre->x_right[x];
+        float          w = pre->x_weight[x];
+
+        dst[0] = l[0] + (r[0] - l[0]) * w;
+        dst[1] = l[1] + (r[1] - l[1]) * w;
+        dst[2] = l[2] + (r[2] - l[2]) * w;
+        dst += 3;
+    }
+
+    return pre->rows[y & 1];
+}
+
+// Like source_row() for integer tensors, the interpolated values in 8.8
+// fixed point.
+static const uint16_t*
+source_row_fixed(Preprocess* pre, const Frame* frame, int32_t y)
+{
+    uint16_t* dst = pre->fixed[y & 1];
+    if (pre->row_y[y & 1] == y) return dst;
+    pre->row_y[y & 1] = y;
+
+    const uint8_t* src = frame->data + (size_t) y * frame->width * 3;
+    for (int32_t x = 0; x < pre->width; x++) {
+        const uint8_t* l  = src + pre->x_left[x];
+        const uint8_t* r  = src + pre->x_right[x];
+        uint32_t       wr = pre->x_fixed[x];
+        uint32_t       wl = 256 - wr;
+
+        dst[0] = (uint16_t) (l[0] * wl + r[0] * wr);
+        dst[1] = (uint16_t) (l[1] * wl + r[1] * wr);
+        dst[2] = (uint16_t) (l[2] * wl + r[2] * wr);
+        dst += 3;
+    }
+
+    return pre->fixed[y & 1];
+}
+
+// Rescales a whitened crop of n floats to zero mean and unit deviation, the
+// deviation bounded below like tf.image.per_image_standardization.
+static void
+whiten(Preprocess* pre, float* data, size_t n)
+{
+    double sum = 0, sum_sq = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += data[i];
+        sum_sq += (double) data[i] * data[i];
+    }
+
+    double mean     = sum / n;
+    double variance = MAX(sum_sq / n - mean * mean, 0.0);
+    double stddev   = MAX(sqrt(variance), 1.0 / sqrt((double) n));
+    size_t row      = (size_t) pre->width * 3;
+
+    // The row buffers are free once the crop is resized, the normalization
+    // tables of pre stay untouched for the next crop.
+    float* scale = pre->rows[0];
+    float* bias  = pre->rows[1];
+    for (size_t i = 0; i < row; i++) {
+        scale[i] = (float) (1.0 / stddev);
+        bias[i]  = (float) (-mean / stddev);
+    }
+
+    PreprocessBlend blend = blend_row(pre->kernel);
+    for (size_t i = 0; i < n; i += row) {
+        blend(data + i, data + i, 0.0f, scale, bias, data + i, row);
+    }
+}
+
+int
+preprocess_load(Preprocess*    pre,
+                NNTensor*      tensor,
+                const Frame*   frame,
+                const int32_t* roi)
+{
+    if (frame->fourcc != FOURCC('R', 'G', 'B', '3') || !frame->data) return -1;
+
+    int32_t x0 = 0, y0 = 0, x1 = frame->width, y1 = frame->height;
+    if (roi) {
+        x0 = CLAMP(roi[0], 0, frame->width);
+        y0 = CLAMP(roi[1], 0, frame->height);
+        x1 = CLAMP(roi[2], 0, frame->width);
+        y1 = CLAMP(roi[3], 0, frame->height);
+    }
+    if (x1 <= x0 || y1 <= y0) return -1;
+
+    for (int32_t x = 0; x < pre->width; x++) {
+        float   sx    = source_coord(x, x0, x1, pre->width);
+        int32_t left  = (int32_t) sx;
+        int32_t right = MIN(left + 1, x1 - 1);
+
+        pre->x_left[x]   = left * 3;
+        pre->x_right[x]  = right * 3;
+        pre->x_weight[x] = sx - left;
+        pre->x_fixed[x]  = (uint16_t) lrintf((sx - left) * 256);
+    }
+    pre->row_y[0] = -1;
+    pre->row_y[1] = -1;
+
+    // Planar tensors place the rows of the three channels plane apart.
+    size_t plane  = (size_t) pre->width * pre->height;
+    size_t stride = (size_t) pre->width * (pre->planar ? 1 : 3) * pre->element;
+    void*  map    = pre->norm == VAAL_IMAGE_PROC_WHITENING
+                        ? nn_tensor_maprw(tensor)
+                        : nn_tensor_mapwo(tensor);
+    if (!map) return -1;
+
+    for (int32_t y = 0; y < pre->height; y++) {
+        float        sy     = source_coord(y, y0, y1, pre->height);
+        int32_t      top    = (int32_t) sy;
+        int32_t      bottom = MIN(top + 1, y1 - 1);
+        float        wy     = sy - top;
+
+        if (pre->quantize) {
+            pre->quantize(pre->lut,
+                          source_row_fixed(pre, frame, top),
+                          source_row_fixed(pre, frame, bottom),
+                          (uint32_t) lrintf(wy * 256),
+                          (uint8_t*) map + y * stride,
+                          pre->width,
+                          plane);
+            continue;
+        }
+
+        const float* a = source_row(pre, frame, top);
+        const float* b = source_row(pre, frame, bottom);
+        if (pre->blend) {
+            pre->blend(a, b, wy, pre->scale, pre->bias, pre->out, pre->width * 3);
+            a  = pre->out;
+            b  = pre->out;
+            wy = 0.0f;
+        }
+        pre->row(a, b, wy, (uint8_t*) map + y * stride, pre->width, plane);
+    }
+
+    if (pre->norm == VAAL_IMAGE_PROC_WHITENING) {
+        whiten(pre, map, plane * 3);
+    }
+
+    nn_tensor_unmap(tensor);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "frame.h"
+#include "vaal.h"
+
+/**
+ * The implementations able to load a head pose crop.  PREPROCESS_VAAL leaves
+ * it to vaal_load_frame_memory() while the others crop, resize and normalize
+ * the frame straight into the input tensor in a single pass.
+ */
+typedef enum {
+    PREPROCESS_VAAL = 0,
+    PREPROCESS_AUTO,   // Fastest kernel supported by this CPU
+    PREPROCESS_SCALAR, // Portable C
+    PREPROCESS_SSE2,   // x86-64 baseline
+    PREPROCESS_AVX2,   // x86-64 with AVX2 and FMA
+    PREPROCESS_NEON,   // ARM Advanced SIMD
+} PreprocessKernel;
+
+/**
+ * Blends the source rows a and b resized to the tensor width, b weighted by
+ * wy, and normalizes the n results into out: (a + (b - a) * wy) * scale +
+ * bias.  Implemented once per instruction set.
+ */
+typedef void (*PreprocessBlend)(const float* a,
+                                const float* b,
+                                float        wy,
+                                const float* scale,
+                                const float* bias,
+                                float*       out,
+                                size_t       n);
+
+/**
+ * Blends width pixels of the source rows a and b, b weighted by wy, applies
+ * the normalization and stores them at dst as floats in the layout of the
+ * tensor, channels of planar tensors plane elements apart.  Generated for
+ * every normalization and layout so no pixel ever branches.
+ */
+typedef void (*PreprocessRow)(const float* a,
+                              const float* b,
+                              float        wy,
+                              void*        dst,
+                              int32_t      width,
+                              size_t       plane);
+
+/**
+ * Blends width pixels of the 8.8 fixed point source rows a and b, b weighted
+ * by wy of 256, rounds them to levels and stores the byte lut holds for the
+ * level of every channel at dst, laid out like PreprocessRow.  Implemented
+ * once per instruction set and layout.
+ */
+typedef void (*PreprocessQuantize)(const uint8_t*  lut,
+                                   const uint16_t* a,
+                                   const uint16_t* b,
+                                   uint32_t        wy,
+                                   uint8_t*        dst,
+                                   int32_t         width,
+                                   size_t          plane);
+
+/**
+ * The lookup tables and row buffers needed by preprocess_load() for one
+ * input tensor layout, sized once so loading a crop never allocates.
+ */
+typedef struct {
+    PreprocessKernel   kernel;   // Resolved kernel, never VAAL or AUTO
+    int                norm;     // VAAL_IMAGE_PROC_* applied to the crop
+    int32_t            width;    // Input tensor width in pixels
+    int32_t            height;   // Input tensor height in pixels
+    bool               planar;   // NCHW input tensor, otherwise NHWC
+    size_t             element;  // Bytes per input tensor element
+    PreprocessBlend    blend;    // SIMD normalization into out or NULL
+    PreprocessRow      row;      // Stores normalized F32 rows, or blends too
+    int32_t*           x_left;   // Source byte offset of the left neighbour
+    int32_t*           x_right;  // Source byte offset of the right neighbour
+    float*             x_weight; // Weight of the right neighbour
+    float*             rows[2];  // Source rows resized to the tensor width
+    int32_t            row_y[2]; // Source row held by each of rows, or -1
+    float*             scale;    // Normalization multiplier per row element
+    float*             bias;     // Normalization offset per row element
+    float*             out;      // Normalized row before conversion
+    // Integer tensors interpolate in 8.8 fixed point instead and map the
+    // level of every channel through lut to its quantized normalized value.
+    PreprocessQuantize quantize; // Loads integer tensors, NULL for F32
+    uint16_t*          x_fixed;  // Weight of the right neighbour of 256
+    uint16_t*          fixed[2]; // Source rows for integer tensors
+    uint8_t*           lut;      // Tensor byte of every level of each channel
+    Arena              arena;    // Holds every array above
+} Preprocess;
+
+/**
+ * Parses a kernel name, one of vaal, auto, scalar, sse2, avx2 or neon.
+ *
+ * Returns 0 on success or -1 if name is unknown.
+ */
+int
+preprocess_parse(const char* name, PreprocessKernel* kernel);
+
+/**
+ * The name of kernel as accepted by preprocess_parse().
+ */
+const char*
+preprocess_name(PreprocessKernel kernel);
+
+/**
+ * Resolves PREPROCESS_AUTO to the fastest kernel this CPU runs.
+ *
+ * Returns the kernel or -1 if kernel was not built in or the CPU lacks the
+ * instructions it needs.
+ */
+int
+preprocess_select(PreprocessKernel kernel);
+
+/**
+ * Prepares pre for crops loaded into tensor, a 1xHxWx3 or 1x3xHxW tensor of
+ * F32, U8 or I8, using kernel and the VAAL_IMAGE_PROC_* flags given by norm.
+ * The row function for the normalization and layout, or the quantize
+ * function of kernel for the layout, is picked here once.  U8 and I8
+ * tensors are written straight from the frame bytes without floats,
+ * normalized values quantized with the scale and zero point of tensor, and
+ * need these unless norm is raw; whitening needs F32.
+ *
+ * Returns 0 on success or -1 with errno set to ENOTSUP when the tensor,
+ * normalization or kernel is not handled and VAAL must load the crops, or
+ * to ENOMEM.
+ */
+int
+preprocess_init(Preprocess*      pre,
+                PreprocessKernel kernel,
+                NNTensor*        tensor,
+                int              norm);
+
+/**
+ * Releases the tables held by pre.
+ */
+void
+preprocess_release(Preprocess* pre);
+
+/**
+ * Loads the region roi of frame, xmin, ymin, xmax, ymax in pixels, into
+ * tensor resized with bilinear interpolation and normalized as
+ * vaal_load_frame_memory() would.
+ *
+ * Returns 0 on success or -1 if frame is not RGB3 or roi is empty, in which
+ * case nothing was written.
+ */
+int
+preprocess_load(Preprocess*    pre,
+                NNTensor*      tensor,
+                const Frame*   frame,
+                const int32_t* roi);
+
+#endif /* PREPROCESS_H */
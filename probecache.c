@@ -0,0 +1,314 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+#include "probecache.h"
+
+// Longest index line, both paths included.
+#define PROBE_CACHE_MAX_LINE (PATH_MAX * 2 + 64)
+
+static int
+index_path(char* path, size_t size)
+{
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home  = getenv("HOME");
+    char        dir[PATH_MAX];
+
+    if (cache && *cache) {
+        snprintf(dir, sizeof(dir), "%s", cache);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        return -1;
+    }
+
+    if (mkdir(dir, 0755) && errno != EEXIST) return -1;
+    if ((size_t) snprintf(path, size, "%s/%s", dir, PROBE_CACHE_FILE) >= size) {
+        return -1;
+    }
+    return 0;
+}
+
+static int64_t
+mtime_ns(const struct stat* st)
+{
+    return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Folds the modification times of the directories in search into one value,
+// changed whenever a model is added to, removed from or renamed within any
+// of them.  Missing directories count as zero.
+static uint64_t
+search_stamp(const char* search)
+{
+    char     dirs[PROBE_CACHE_MAX_LINE];
+    uint64_t stamp = 14695981039346656037ULL;
+
+    snprintf(dirs, sizeof(dirs), "%s", search);
+    for (char* save = NULL, *dir = strtok_r(dirs, ":", &save); dir;
+         dir = strtok_r(NULL, ":", &save)) {
+        struct stat st;
+        uint64_t    mtime = stat(dir, &st) ? 0 : (uint64_t) mtime_ns(&st);
+        // FNV-1a over the bytes of each time.
+        for (size_t i = 0; i < sizeof(mtime); i++) {
+            stamp = (stamp ^ ((mtime >> (i * 8)) & 0xff)) * 1099511628211ULL;
+        }
+    }
+    return stamp;
+}
+
+// Splits an index line into its type, search stamp, model mtime and size,
+// and the search and model strings, NULL terminating both within line.
+static bool
+index_parse(char*        line,
+            int*         type,
+            uint64_t*    stamp,
+            long long*   mtime,
+            long long*   length,
+            char**       search,
+            char**       model)
+{
+    unsigned long long entry_stamp;
+    int                offset = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    int fields = sscanf(line,
+                        "%d\t%llu\t%lld\t%lld\t%n",
+                        type,
+                        &entry_stamp,
+                        mtime,
+                        length,
+                        &offset);
+    if (fields != 4 || !offset) return false;
+
+    *stamp  = entry_stamp;
+    *search = line + offset;
+    *model  = strchr(*search, '\t');
+    if (!*model) return false;
+    *(*model)++ = '\0';
+    return true;
+}
+
+// Finds the model of type recorded for search, the VAAL_MODEL_PATH value,
+// while neither the directories of search, stamped as stamp, nor the model
+// changed on disk.  Lines are type, stamp, mtime, size, search and model
+// path separated by tabs.
+static bool
+index_lookup(int         type,
+             const char* search,
+             uint64_t    stamp,
+             char*       model,
+             size_t      size)
+{
+    char path[PATH_MAX];
+    char line[PROBE_CACHE_MAX_LINE];
+    bool found = false;
+
+    if (index_path(path, sizeof(path))) return false;
+    FILE* fp = fopen(path, "r");
+    if (!fp) return false;
+
+    while (!found && fgets(line, sizeof(line), fp)) {
+        int       entry_type;
+        uint64_t  entry_stamp;
+        long long mtime, length;
+        char *    entry_search, *entry_model;
+
+        if (!index_parse(line,
+                         &entry_type,
+                         &entry_stamp,
+                         &mtime,
+                         &length,
+                         &entry_search,
+                         &entry_model) ||
+            entry_type != type || entry_stamp != stamp ||
+            strcmp(entry_search, search) != 0) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(entry_model, &st) == 0 && mtime_ns(&st) == mtime &&
+            st.st_size == length) {
+            snprintf(model, size, "%s", entry_model);
+            found = true;
+        }
+    }
+
+    fclose(fp);
+    return found;
+}
+
+// Replaces the entry of type and search with model, written to a temporary
+// file of its own renamed over the index, so concurrent runs and the
+// workers of one run never read half of it.  Lines of an older layout are
+// dropped.
+static void
+index_store(int type, const char* search, uint64_t stamp, const char* model)
+{
+    char        path[PATH_MAX], temp[PATH_MAX + 16];
+    char        line[PROBE_CACHE_MAX_LINE], entry[PROBE_CACHE_MAX_LINE];
+    struct stat st;
+
+    if (stat(model, &st) || index_path(path, sizeof(path))) return;
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+
+    int fd = mkstemp(temp);
+    if (fd == -1) return;
+    fchmod(fd, 0644);
+    FILE* out = fdopen(fd, "w");
+    if (!out) {
+        close(fd);
+        remove(temp);
+        return;
+    }
+
+    FILE* in = fopen(path, "r");
+    if (in) {
+        while (fgets(line, sizeof(line), in)) {
+            int       entry_type;
+            uint64_t  entry_stamp;
+            long long mtime, length;
+            char *    entry_search, *entry_model;
+
+            memcpy(entry, line, sizeof(entry));
+            if (!index_parse(entry,
+                             &entry_type,
+                             &entry_stamp,
+                             &mtime,
+                             &length,
+                             &entry_search,
+                             &entry_model) ||
+                (entry_type == type && strcmp(entry_search, search) == 0)) {
+                continue;
+            }
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+
+    fprintf(out,
+            "%d\t%llu\t%lld\t%lld\t%s\t%s\n",
+            type,
+            (unsigned long long) stamp,
+            (long long) mtime_ns(&st),
+            (long long) st.st_size,
+            search,
+            model);
+    if (fclose(out) || rename(temp, path)) remove(temp);
+}
+
+// Compares the model string a, which may be missing, with b.
+static bool
+same_string(const char* a, const char* b)
+{
+    return strcmp(a ? a : "", b) == 0;
+}
+
+// Tells which model of the directories in search ctx holds: the one file,
+// exclude aside, whose model name and UUID are those of the model loaded
+// into ctx.  Without a UUID, or with several files matching, the model is
+// not known for certain and nothing is told.
+static bool
+identify(VAALContext* ctx,
+         const char*  search,
+         const char*  exclude,
+         char*        model,
+         size_t       size)
+{
+    char   dirs[PROBE_CACHE_MAX_LINE];
+    char   excluded[PATH_MAX] = "";
+    char   name[PATH_MAX], uuid[64];
+    size_t matches = 0;
+
+    NNContext*     nn     = vaal_context_deepviewrt(ctx);
+    const NNModel* loaded = nn ? nn_context_model(nn) : NULL;
+    if (!loaded) return false;
+    const char* loaded_name = nn_model_name(loaded);
+    const char* loaded_uuid = nn_model_uuid(loaded);
+    if (!loaded_uuid || !*loaded_uuid) return false;
+    // Copied as the strings need not outlive the next model queried.
+    snprintf(name, sizeof(name), "%s", loaded_name ? loaded_name : "");
+    snprintf(uuid, sizeof(uuid), "%s", loaded_uuid);
+
+    if (exclude && !realpath(exclude, excluded)) excluded[0] = '\0';
+    snprintf(dirs, sizeof(dirs), "%s", search);
+
+    for (char* save = NULL, *dir = strtok_r(dirs, ":", &save); dir;
+         dir = strtok_r(NULL, ":", &save)) {
+        DIR* d = opendir(dir);
+        if (!d) continue;
+
+        struct dirent* entry;
+        while ((entry = readdir(d))) {
+            char       path[PATH_MAX], real[PATH_MAX];
+            MappedFile file;
+            if (fnmatch("*.rtm", entry->d_name, 0)) continue;
+            int length =
+                snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            if ((size_t) length >= sizeof(path) || !realpath(path, real) ||
+                strcmp(real, excluded) == 0 || mapped_file_open(&file, real)) {
+                continue;
+            }
+
+            if (file.data && nn_model_validate(file.data, file.size) == 0 &&
+                same_string(nn_model_name(file.data), name) &&
+                same_string(nn_model_uuid(file.data), uuid) &&
+                ++matches == 1) {
+                snprintf(model, size, "%s", real);
+            }
+            mapped_file_close(&file);
+        }
+        closedir(d);
+    }
+
+    return matches == 1;
+}
+
+VAALContext*
+probe_cache_model(const char* engine, int type, const char* exclude)
+{
+    const char* search = getenv("VAAL_MODEL_PATH");
+    char        model[PATH_MAX];
+
+    if (!search || !*search) return vaal_model_probe(engine, type);
+
+    uint64_t stamp = search_stamp(search);
+    if (index_lookup(type, search, stamp, model, sizeof(model))) {
+        VAALContext* ctx = vaal_context_create(engine);
+        if (ctx && vaal_load_model_file(ctx, model) == VAAL_SUCCESS) return ctx;
+        if (ctx) vaal_context_release(ctx);
+    }
+
+    VAALContext* ctx = vaal_model_probe(engine, type);
+    if (ctx && identify(ctx, search, exclude, model, sizeof(model))) {
+        index_store(type, search, stamp, model);
+    }
+    return ctx;
+}
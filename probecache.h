@@ -0,0 +1,43 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+#include "vaal.h"
+
+// Index file of resolved models within $XDG_CACHE_HOME or ~/.cache.
+#define PROBE_CACHE_FILE "headposeimg-models"
+
+/**
+ * Creates a context on engine for the model of type found through
+ * VAAL_MODEL_PATH, like vaal_model_probe(), but remembers which file that
+ * was in a small index keyed by VAAL_MODEL_PATH, the modification times of
+ * its directories, the model path and the modification time and size of the
+ * model.  Later runs load that file straight away instead of scanning
+ * VAAL_MODEL_PATH until any of them changes.  The model file is only
+ * recorded when it is the one model in VAAL_MODEL_PATH, exclude aside,
+ * whose name and UUID are those of the model the probe loaded; otherwise
+ * every run probes.
+ *
+ * Returns the loaded context or NULL when no model of type was found.
+ */
+VAALContext*
+probe_cache_model(const char* engine, int type, const char* exclude);
+
+#endif /* PROBECACHE_H */
@@ -0,0 +1,265 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+// Runs the share of engine, on its own thread for helper engines, and folds
+// the time it took per face into its moving average.
+static void
+engine_run(PoseScheduler* scheduler, PoseEngine* engine)
+{
+    int64_t* face_ns = scheduler->face_ns;
+
+    engine->timing = (PoseTiming){
+        .face_ns = face_ns ? face_ns + engine->first : NULL,
+    };
+    engine->err = VAAL_SUCCESS;
+    if (!engine->count) return;
+
+    int64_t start = vaal_clock_now();
+    engine->err   = pose_batch_run(engine->batch,
+                                 scheduler->frame,
+                                 scheduler->path,
+                                 scheduler->rois + engine->first,
+                                 engine->count,
+                                 scheduler->orientations + engine->first,
+                                 &engine->timing);
+    if (engine->err) return;
+
+    double per_face = (double) (vaal_clock_now() - start) / engine->count;
+    if (engine->face_ns > 0) {
+        engine->face_ns += SCHEDULER_EWMA_ALPHA * (per_face - engine->face_ns);
+    } else {
+        engine->face_ns = per_face;
+    }
+    engine->faces += engine->count;
+}
+
+static void*
+engine_thread(void* arg)
+{
+    PoseEngine*    engine    = arg;
+    PoseScheduler* scheduler = engine->scheduler;
+
+    pthread_mutex_lock(&scheduler->lock);
+    for (;;) {
+        while (!scheduler->stopping && engine->run == scheduler->run) {
+            pthread_cond_wait(&scheduler->cond, &scheduler->lock);
+        }
+        if (scheduler->stopping) break;
+        engine->run = scheduler->run;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        engine_run(scheduler, engine);
+
+        pthread_mutex_lock(&scheduler->lock);
+        if (--scheduler->pending == 0) pthread_cond_broadcast(&scheduler->cond);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return NULL;
+}
+
+// Deals count faces one at a time to the engine that would be done with its
+// share soonest given its time per face.  An engine not measured yet gets a
+// single face to be measured on, the first engine takes every face until it
+// has been measured itself.  Returns whether any helper engine got a face.
+static bool
+deal(PoseScheduler* scheduler, size_t count)
+{
+    PoseEngine* engines = scheduler->engines;
+    size_t      left    = count;
+    bool        helpers = false;
+
+    for (size_t i = 0; i < scheduler->num_engines; i++) engines[i].count = 0;
+
+    for (size_t i = 1; i < scheduler->num_engines && left > 1; i++) {
+        if (engines[i].face_ns <= 0) {
+            engines[i].count = 1;
+            left--;
+        }
+    }
+
+    while (left--) {
+        size_t best      = 0;
+        double best_done = (engines[0].count + 1) * MAX(engines[0].face_ns, 0);
+        for (size_t i = 1; i < scheduler->num_engines; i++) {
+            if (engines[i].face_ns <= 0) continue;
+            double done = (engines[i].count + 1) * engines[i].face_ns;
+            if (done < best_done) {
+                best      = i;
+                best_done = done;
+            }
+        }
+        engines[best].count++;
+    }
+
+    size_t first = 0;
+    for (size_t i = 0; i < scheduler->num_engines; i++) {
+        engines[i].first = first;
+        first += engines[i].count;
+        if (i > 0 && engines[i].count) helpers = true;
+    }
+
+    return helpers;
+}
+
+int
+pose_scheduler_init(PoseScheduler* scheduler,
+                    PoseBatch*     batch,
+                    const char*    engine)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+
+    if (pthread_mutex_init(&scheduler->lock, NULL)) return -1;
+    if (pthread_cond_init(&scheduler->cond, NULL)) {
+        pthread_mutex_destroy(&scheduler->lock);
+        return -1;
+    }
+
+    scheduler->engines[0] = (PoseEngine){
+        .scheduler = scheduler,
+        .batch     = batch,
+    };
+    snprintf(scheduler->engines[0].engine,
+             sizeof(scheduler->engines[0].engine),
+             "%s",
+             engine);
+    scheduler->num_engines = 1;
+
+    return 0;
+}
+
+int
+pose_scheduler_add(PoseScheduler* scheduler, PoseBatch* batch, const char* engine)
+{
+    if (scheduler->num_engines == SCHEDULER_MAX_ENGINES) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    PoseEngine* helper = &scheduler->engines[scheduler->num_engines];
+    *helper            = (PoseEngine){
+        .scheduler = scheduler,
+        .batch     = batch,
+        .run       = scheduler->run,
+    };
+    snprintf(helper->engine, sizeof(helper->engine), "%s", engine);
+
+    int err = pthread_create(&helper->thread, NULL, engine_thread, helper);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    helper->started = true;
+    scheduler->num_engines++;
+
+    return 0;
+}
+
+void
+pose_scheduler_release(PoseScheduler* scheduler)
+{
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = true;
+    pthread_cond_broadcast(&scheduler->cond);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (size_t i = 1; i < scheduler->num_engines; i++) {
+        PoseEngine*  helper = &scheduler->engines[i];
+        VAALContext* ctx    = helper->batch->ctx;
+
+        if (helper->started) pthread_join(helper->thread, NULL);
+        pose_batch_release(helper->batch);
+        vaal_context_release(ctx);
+        free(helper->batch);
+    }
+
+    pthread_cond_destroy(&scheduler->cond);
+    pthread_mutex_destroy(&scheduler->lock);
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+VAALError
+pose_scheduler_run(PoseScheduler* scheduler,
+                   const Frame*   frame,
+                   const char*    path,
+                   int32_t        (*rois)[4],
+                   size_t         count,
+                   VAALEuler*     orientations,
+                   PoseTiming*    timing)
+{
+    scheduler->frame        = frame;
+    scheduler->path         = path;
+    scheduler->rois         = rois;
+    scheduler->orientations = orientations;
+    scheduler->face_ns      = timing ? timing->face_ns : NULL;
+
+    // The helpers are only woken when one of them has work.
+    bool helpers = deal(scheduler, count);
+    if (helpers) {
+        pthread_mutex_lock(&scheduler->lock);
+        scheduler->run++;
+        scheduler->pending = scheduler->num_engines - 1;
+        pthread_cond_broadcast(&scheduler->cond);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+
+    engine_run(scheduler, &scheduler->engines[0]);
+
+    if (helpers) {
+        pthread_mutex_lock(&scheduler->lock);
+        while (scheduler->pending) {
+            pthread_cond_wait(&scheduler->cond, &scheduler->lock);
+        }
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+
+    VAALError err = VAAL_SUCCESS;
+    for (size_t i = 0; i < scheduler->num_engines; i++) {
+        const PoseEngine* engine = &scheduler->engines[i];
+        if (!engine->count) continue;
+        if (!err) err = engine->err;
+        if (timing) {
+            timing->load_ns += engine->timing.load_ns;
+            timing->inference_ns += engine->timing.inference_ns;
+            timing->euler_ns += engine->timing.euler_ns;
+        }
+    }
+
+    return err;
+}
+
+void
+pose_scheduler_print(const PoseScheduler* scheduler, FILE* out)
+{
+    fprintf(out, "Pose engines:");
+    for (size_t i = 0; i < scheduler->num_engines; i++) {
+        const PoseEngine* engine = &scheduler->engines[i];
+        fprintf(out,
+                " %s %llu faces %.4f ms/face%s",
+                engine->engine,
+                (unsigned long long) engine->faces,
+                engine->face_ns / 1e6,
+                i + 1 < scheduler->num_engines ? "," : "\n");
+    }
+}
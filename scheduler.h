@@ -0,0 +1,129 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "frame.h"
+#include "pose.h"
+#include "vaal.h"
+
+// Most head pose contexts a scheduler spreads faces over.
+#define SCHEDULER_MAX_ENGINES 8
+
+// Weight of the latest measurement in the smoothed time per face.
+#define SCHEDULER_EWMA_ALPHA 0.2
+
+struct PoseScheduler;
+
+/**
+ * One head pose context of the scheduler and the share of the current faces
+ * it was dealt.  Every engine but the first runs on its own thread.
+ */
+typedef struct {
+    struct PoseScheduler* scheduler;
+    PoseBatch*            batch;      // Head pose model on this engine
+    char                  engine[32]; // Compute engine of batch
+    double                face_ns;    // Smoothed time per face, 0 until measured
+    uint64_t              faces;      // Faces estimated so far
+    size_t                first;      // First face of the current share
+    size_t                count;      // Faces of the current share
+    PoseTiming            timing;     // Steps of the current share
+    VAALError             err;        // Outcome of the current share
+    uint64_t              run;        // Last run this engine has seen
+    pthread_t             thread;
+    bool                  started;    // Whether thread is running
+} PoseEngine;
+
+/**
+ * Spreads the faces of an image over head pose contexts on several compute
+ * engines, such as the NPU and a few CPU contexts, so a frame with many
+ * faces does not queue them all behind the one engine.  Faces are dealt in
+ * proportion to the throughput measured on previous images, an engine only
+ * gets a face when it would finish it before the others, so slower engines
+ * stay idle on images with few faces.
+ */
+typedef struct PoseScheduler {
+    PoseEngine      engines[SCHEDULER_MAX_ENGINES];
+    size_t          num_engines;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint64_t        run;          // Incremented for every pose_scheduler_run()
+    size_t          pending;      // Helper engines still busy with the run
+    bool            stopping;     // Helpers must exit
+    const Frame*    frame;        // Faces of the current run
+    const char*     path;
+    int32_t         (*rois)[4];
+    VAALEuler*      orientations;
+    int64_t*        face_ns;
+} PoseScheduler;
+
+/**
+ * Prepares scheduler with batch, on engine, as its first engine which runs
+ * on the thread calling pose_scheduler_run().  The batch stays owned by the
+ * caller, engine is copied for pose_scheduler_print().
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int
+pose_scheduler_init(PoseScheduler* scheduler,
+                    PoseBatch*     batch,
+                    const char*    engine);
+
+/**
+ * Adds batch, on engine, as another engine served by a thread of its own.
+ * The scheduler takes ownership of batch and its context.
+ *
+ * Returns 0 on success or -1 when full or the thread cannot be started.
+ */
+int
+pose_scheduler_add(PoseScheduler* scheduler, PoseBatch* batch, const char* engine);
+
+/**
+ * Stops the helper threads and releases the batches and contexts they own.
+ */
+void
+pose_scheduler_release(PoseScheduler* scheduler);
+
+/**
+ * Estimates count faces like pose_batch_run(), split over the engines of
+ * scheduler, and returns once every engine is done.  The step timings are
+ * summed over the engines.
+ */
+VAALError
+pose_scheduler_run(PoseScheduler* scheduler,
+                   const Frame*   frame,
+                   const char*    path,
+                   int32_t        (*rois)[4],
+                   size_t         count,
+                   VAALEuler*     orientations,
+                   PoseTiming*    timing);
+
+/**
+ * Prints the faces and smoothed time per face of every engine to out.
+ */
+void
+pose_scheduler_print(const PoseScheduler* scheduler, FILE* out);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,225 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "server.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void
+on_signal(int signum)
+{
+    (void) signum;
+    stopping = 1;
+}
+
+// Finishes the stages of a decoded job, or of one whose decoding returned
+// the failure decode_err, and answers the request.  Returns true unless the
+// client can no longer be written to.
+static bool
+serve_job(const Stages* stages,
+          Job*          job,
+          int           decode_err,
+          Output*       output,
+          Stats*        stats)
+{
+    if (decode_err || stage_detect(stages, job) || stage_pose(stages, job)) {
+        output_error(output,
+                     job->path,
+                     decode_err ? frame_error() : "failed to process image");
+    } else {
+        int64_t start = vaal_clock_now();
+        output_job(output, job);
+        stats_add_job(stats, job, vaal_clock_now() - start);
+    }
+
+    return !output->error;
+}
+
+static void
+serve_client(const Stages* stages, Job* job, int fd, Stats* stats)
+{
+    Output   output;
+    FILE*    in     = fdopen(fd, "r");
+    char*    line   = NULL;
+    size_t   cap    = 0;
+    uint8_t* data   = NULL;
+    size_t   length = 0;
+    ssize_t  n;
+
+    if (!in) {
+        fprintf(stderr, "failed to open client: %s\n", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    if (output_open_fd(&output, OUTPUT_JSONL, fd)) {
+        fclose(in);
+        return;
+    }
+    // Every request expects its answer before sending the next.
+    output.flush = true;
+
+    while (!stopping && (n = getline(&line, &cap, in)) != -1) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            line[--n] = '\0';
+        }
+        if (n == 0) continue;
+
+        if (strncmp(line, "FILE ", 5) == 0) {
+            snprintf(job->path, sizeof(job->path), "%s", line + 5);
+            if (!serve_job(stages,
+                           job,
+                           stage_decode(stages, job),
+                           &output,
+                           stats)) {
+                break;
+            }
+        } else if (strncmp(line, "DATA ", 5) == 0) {
+            char*              end;
+            unsigned long long size = strtoull(line + 5, &end, 10);
+
+            if (end == line + 5 || (*end && *end != ' ') ||
+                size > SERVER_MAX_DATA) {
+                // The image bytes cannot be skipped without a valid size.
+                output_error(&output, line, "invalid image size");
+                break;
+            }
+
+            if (size > length) {
+                uint8_t* grown = realloc(data, size);
+                if (!grown) {
+                    output_error(&output, line, strerror(errno));
+                    break;
+                }
+                data   = grown;
+                length = size;
+            }
+            if (fread(data, 1, size, in) != size) break;
+
+            snprintf(job->path,
+                     sizeof(job->path),
+                     "%s",
+                     *end ? end + 1 : "-");
+            if (!serve_job(stages,
+                           job,
+                           stage_decode_memory(stages, job, data, size),
+                           &output,
+                           stats)) {
+                break;
+            }
+        } else {
+            output_error(&output, line, "unknown request");
+        }
+    }
+
+    free(data);
+    free(line);
+    output_close(&output);
+    fclose(in);
+}
+
+int
+server_run(const Stages* stages, const char* path, Stats* stats)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Requests may hold raw image bytes, everything is decoded from memory.
+    Stages shared       = *stages;
+    shared.shared_frame = true;
+    // Requests are independent images, possibly from several clients.
+    shared.tracker    = NULL;
+    shared.pose_cache = NULL;
+
+    Job job;
+    if (job_init(&job, stages->max_detection)) {
+        fprintf(stderr, "failed to allocate job: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        fprintf(stderr, "failed to create socket: %s\n", strerror(errno));
+        job_release(&job);
+        return -1;
+    }
+
+    // Only a socket left behind by an earlier server is replaced, never
+    // whatever other file sits at path.
+    struct stat st;
+    int         err = 0;
+    if (lstat(path, &st) == 0) {
+        if (S_ISSOCK(st.st_mode)) {
+            unlink(path);
+        } else {
+            err = EADDRINUSE;
+        }
+    }
+    if (err || bind(sock, (struct sockaddr*) &addr, sizeof(addr)) ||
+        listen(sock, SOMAXCONN)) {
+        fprintf(stderr,
+                "failed to listen on %s: %s\n",
+                path,
+                strerror(err ? err : errno));
+        close(sock);
+        job_release(&job);
+        return -1;
+    }
+
+    // Without SA_RESTART a signal interrupts accept() and reads so the
+    // server stops promptly, a client going away must not kill it.
+    struct sigaction action = {.sa_handler = on_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int status = 0;
+    while (!stopping) {
+        int client = accept(sock, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "failed to accept client: %s\n", strerror(errno));
+            status = -1;
+            break;
+        }
+        serve_client(&shared, &job, client, stats);
+    }
+
+    close(sock);
+    unlink(path);
+    job_release(&job);
+
+    return status;
+}
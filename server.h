@@ -0,0 +1,51 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "stages.h"
+#include "stats.h"
+
+// Largest image accepted by a DATA request.
+#define SERVER_MAX_DATA (64 << 20)
+
+/**
+ * Serves head pose requests on the Unix stream socket at path until SIGINT
+ * or SIGTERM, keeping the contexts of stages loaded between requests.  Any
+ * file already at path is replaced.
+ *
+ * Clients are served one at a time.  Each request is a line, either
+ *
+ *     FILE <path>
+ *         Process the image file at path on the server.
+ *     DATA <size> [name]
+ *         Followed by size bytes of encoded image, reported as name.
+ *
+ * and is answered with a single JSON line, the --output_format jsonl object
+ * of the image or {"file": ..., "error": ...} when it cannot be processed.
+ * A failed request does not end the connection.
+ *
+ * Completed requests are recorded into stats.
+ *
+ * Returns 0 once stopped or -1 after reporting the failure on stderr.
+ */
+int
+server_run(const Stages* stages, const char* path, Stats* stats);
+
+#endif /* SERVER_H */
@@ -0,0 +1,329 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shmring.h"
+
+// Bytes of a frame in the packed formats the stages decode or capture, 0
+// for any other.
+static size_t
+frame_bytes(const Frame* frame)
+{
+    size_t pixels = (size_t) frame->width * frame->height;
+
+    switch (frame->fourcc) {
+    case FOURCC('R', 'G', 'B', '3'):
+        return pixels * 3;
+    case FOURCC('Y', 'U', 'Y', 'V'):
+        return pixels * 2;
+    case FOURCC('N', 'V', '1', '2'):
+        return pixels * 3 / 2;
+    default:
+        return 0;
+    }
+}
+
+// Slots start on cache lines so neighbouring slots never share one.
+static size_t
+line_align(size_t size)
+{
+    return (size + 63) & ~(size_t) 63;
+}
+
+static ShmRingRecord*
+record_slot(const ShmRing* ring, uint64_t number)
+{
+    const ShmRingHeader* header = ring->header;
+    size_t               slot   = (number - 1) & (header->slots - 1);
+
+    return (ShmRingRecord*) ((uint8_t*) ring->map + header->records +
+                             slot * header->record_size);
+}
+
+static ShmRingFrame*
+frame_slot(const ShmRing* ring, uint32_t slot)
+{
+    const ShmRingHeader* header = ring->header;
+
+    return (ShmRingFrame*) ((uint8_t*) ring->map + header->frame_data +
+                            slot * header->frame_stride);
+}
+
+// Shared memory object names are a single component with a leading slash.
+static int
+ring_name(ShmRing* ring, const char* name)
+{
+    int n = snprintf(ring->name,
+                     sizeof(ring->name),
+                     "%s%s",
+                     name[0] == '/' ? "" : "/",
+                     name);
+    if (n < 0 || (size_t) n >= sizeof(ring->name) ||
+        strchr(ring->name + 1, '/')) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int
+shm_ring_create(ShmRing*    ring,
+                const char* name,
+                size_t      max_faces,
+                size_t      frame_size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    if (ring_name(ring, name)) {
+        fprintf(stderr, "invalid shared memory name: %s\n", name);
+        return -1;
+    }
+
+    size_t record_size =
+        line_align(sizeof(ShmRingRecord) + max_faces * sizeof(OutputBinFace));
+    size_t frame_stride =
+        frame_size ? sizeof(ShmRingFrame) + line_align(frame_size) : 0;
+    size_t records    = line_align(sizeof(ShmRingHeader));
+    size_t frame_data = records + SHM_RING_SLOTS * record_size;
+    size_t frames     = frame_size ? SHM_RING_FRAMES : 0;
+    ring->size        = frame_data + frames * frame_stride;
+
+    // A fresh object, readers still mapping the previous one keep theirs.
+    shm_unlink(ring->name);
+    ring->fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (ring->fd == -1 || ftruncate(ring->fd, ring->size)) {
+        fprintf(stderr,
+                "failed to create shared memory %s: %s\n",
+                ring->name,
+                strerror(errno));
+        if (ring->fd != -1) {
+            close(ring->fd);
+            shm_unlink(ring->name);
+        }
+        return -1;
+    }
+    ring->owner = true;
+
+    ring->map = mmap(NULL,
+                     ring->size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED,
+                     ring->fd,
+                     0);
+    if (ring->map == MAP_FAILED) {
+        fprintf(stderr,
+                "failed to map shared memory %s: %s\n",
+                ring->name,
+                strerror(errno));
+        ring->map = NULL;
+        shm_ring_close(ring);
+        return -1;
+    }
+
+    // The object is zero filled, so every slot starts as never written.
+    ShmRingHeader* header = ring->map;
+    header->version       = SHM_RING_VERSION;
+    header->slots         = SHM_RING_SLOTS;
+    header->max_faces     = max_faces;
+    header->record_size   = record_size;
+    header->frames        = frames;
+    header->frame_size    = frame_size;
+    header->frame_stride  = frame_stride;
+    header->records       = records;
+    header->frame_data    = frame_data;
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHM_RING_MAGIC, 4);
+    ring->header = header;
+
+    return 0;
+}
+
+int
+shm_ring_attach(ShmRing* ring, const char* name)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    if (ring_name(ring, name)) return -1;
+
+    struct stat st;
+    ring->fd = shm_open(ring->name, O_RDONLY, 0);
+    if (ring->fd == -1 || fstat(ring->fd, &st)) {
+        shm_ring_close(ring);
+        return -1;
+    }
+    ring->size = st.st_size;
+    if (ring->size < sizeof(ShmRingHeader)) {
+        shm_ring_close(ring);
+        errno = EPROTO;
+        return -1;
+    }
+
+    ring->map = mmap(NULL, ring->size, PROT_READ, MAP_SHARED, ring->fd, 0);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        shm_ring_close(ring);
+        return -1;
+    }
+
+    // The magic is written last, the layout is complete once it reads back.
+    const ShmRingHeader* header = ring->map;
+    bool laid = memcmp(header->magic, SHM_RING_MAGIC, 4) == 0;
+    atomic_thread_fence(memory_order_acquire);
+    if (!laid || header->version != SHM_RING_VERSION ||
+        header->frame_data + header->frames * header->frame_stride >
+            ring->size) {
+        shm_ring_close(ring);
+        errno = EPROTO;
+        return -1;
+    }
+    ring->header = (ShmRingHeader*) header;
+
+    return 0;
+}
+
+void
+shm_ring_publish(ShmRing* ring, const Job* job)
+{
+    ShmRingHeader* header = ring->header;
+    const Frame*   frame  = &job->frame;
+    size_t         bytes  = frame->data ? frame_bytes(frame) : 0;
+    uint32_t       slot   = SHM_RING_NO_FRAME;
+
+    // Only this process writes head.
+    uint64_t number =
+        atomic_load_explicit(&header->head, memory_order_relaxed) + 1;
+
+    // Pixels go first so the record never points at a frame in progress.
+    if (header->frames && bytes && bytes <= header->frame_size) {
+        slot                 = (number - 1) % header->frames;
+        ShmRingFrame* shared = frame_slot(ring, slot);
+        atomic_store_explicit(&shared->seq,
+                              2 * number - 1,
+                              memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(shared + 1, frame->data, bytes);
+        atomic_store_explicit(&shared->seq, 2 * number, memory_order_release);
+    }
+
+    ShmRingRecord* record = record_slot(ring, number);
+    atomic_store_explicit(&record->seq, 2 * number - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    size_t faces         = output_faces(job);
+    record->time_ns      = job->start_ns;
+    record->width        = job->width;
+    record->height       = job->height;
+    record->num_faces    = MIN(faces, header->max_faces);
+    record->frame        = slot;
+    record->frame_fourcc = frame->fourcc;
+    record->frame_width  = frame->width;
+    record->frame_height = frame->height;
+    record->frame_bytes  = slot == SHM_RING_NO_FRAME ? 0 : bytes;
+    size_t length = MIN(strlen(job->path), sizeof(record->path) - 1);
+    memcpy(record->path, job->path, length);
+    record->path[length] = '\0';
+    for (size_t i = 0; i < record->num_faces; i++) {
+        output_face(job, i, &record->faces[i]);
+    }
+
+    atomic_store_explicit(&record->seq, 2 * number, memory_order_release);
+    atomic_store_explicit(&header->head, number, memory_order_release);
+}
+
+uint64_t
+shm_ring_head(const ShmRing* ring)
+{
+    return atomic_load_explicit(&ring->header->head, memory_order_acquire);
+}
+
+int
+shm_ring_read(const ShmRing* ring, uint64_t number, ShmRingRecord* record)
+{
+    const ShmRingHeader* header = ring->header;
+    uint64_t             head   = shm_ring_head(ring);
+
+    if (number == 0 || number > head) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (head - number >= header->slots) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    ShmRingRecord* shared = record_slot(ring, number);
+    uint64_t seq = atomic_load_explicit(&shared->seq, memory_order_acquire);
+    memcpy((uint8_t*) record + sizeof(record->seq),
+           (const uint8_t*) shared + sizeof(shared->seq),
+           header->record_size - sizeof(shared->seq));
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t again = atomic_load_explicit(&shared->seq, memory_order_relaxed);
+
+    if (seq != 2 * number || again != seq) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    atomic_store_explicit(&record->seq, seq, memory_order_relaxed);
+    record->num_faces = MIN(record->num_faces, header->max_faces);
+
+    return 0;
+}
+
+const uint8_t*
+shm_ring_frame(const ShmRing* ring, const ShmRingRecord* record)
+{
+    if (record->frame >= ring->header->frames ||
+        record->frame_bytes > ring->header->frame_size) {
+        return NULL;
+    }
+    return (const uint8_t*) (frame_slot(ring, record->frame) + 1);
+}
+
+bool
+shm_ring_frame_valid(const ShmRing*       ring,
+                     const ShmRingRecord* record,
+                     uint64_t             number)
+{
+    if (record->frame >= ring->header->frames) return false;
+
+    atomic_thread_fence(memory_order_acquire);
+    ShmRingFrame* shared = frame_slot(ring, record->frame);
+    return atomic_load_explicit(&shared->seq, memory_order_relaxed) ==
+           2 * number;
+}
+
+void
+shm_ring_close(ShmRing* ring)
+{
+    if (ring->map) munmap(ring->map, ring->size);
+    if (ring->fd != -1) close(ring->fd);
+    if (ring->owner) shm_unlink(ring->name);
+    ring->map    = NULL;
+    ring->header = NULL;
+    ring->fd     = -1;
+    ring->owner  = false;
+}
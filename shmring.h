@@ -0,0 +1,177 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+#include "stages.h"
+
+// Leading bytes of the shared memory object, written once it is laid out.
+#define SHM_RING_MAGIC "HPSR"
+#define SHM_RING_VERSION 1
+
+// Records kept before the oldest is overwritten, a power of two.
+#define SHM_RING_SLOTS 256
+
+// Frames kept before the oldest is overwritten.
+#define SHM_RING_FRAMES 4
+
+// Frame slot of records published without their pixels.
+#define SHM_RING_NO_FRAME UINT32_MAX
+
+/**
+ * The shared memory object starts with this header.  Record n, counted from
+ * 1, lives in slot (n - 1) % slots at records + slot * record_size, its
+ * pixels, when carried, in frame slot (n - 1) % frames at frames + slot *
+ * frame_stride, both offsets from the start of the object.
+ */
+typedef struct {
+    char             magic[4];
+    uint32_t         version;
+    uint32_t         slots;        // Record slots, SHM_RING_SLOTS
+    uint32_t         max_faces;    // Faces a record has room for
+    uint32_t         record_size;  // Bytes between record slots
+    uint32_t         frames;       // Frame slots, 0 without pixels
+    uint64_t         frame_size;   // Largest frame a frame slot holds
+    uint64_t         frame_stride; // Bytes between frame slots
+    uint64_t         records;      // Offset of the first record slot
+    uint64_t         frame_data;   // Offset of the first frame slot
+    _Atomic uint64_t head;         // Number of the newest complete record
+} ShmRingHeader;
+
+/**
+ * The results of one image.  seq is 2n - 1 while record n is written and 2n
+ * once it is complete, readers copy the record out and check seq has not
+ * moved meanwhile.
+ */
+typedef struct {
+    _Atomic uint64_t seq;
+    int64_t          time_ns;      // Clock when the image entered the stages
+    int32_t          width;        // Image width in pixels
+    int32_t          height;       // Image height in pixels
+    uint32_t         num_faces;    // Faces stored, at most max_faces
+    uint32_t         frame;        // Frame slot or SHM_RING_NO_FRAME
+    uint32_t         frame_fourcc; // Pixel format of the frame
+    int32_t          frame_width;  // Frame width, reduced for the detector
+    int32_t          frame_height; // when decoded with --jpeg_scaled
+    uint32_t         frame_bytes;  // Bytes of pixels in the frame slot
+    char             path[256];    // Truncated and terminated
+    OutputBinFace    faces[];
+} ShmRingRecord;
+
+/**
+ * A frame slot, the pixels follow the header.  seq follows the record
+ * protocol with the number of the record the pixels belong to.
+ */
+typedef struct {
+    _Atomic uint64_t seq;
+    uint64_t         reserved[7]; // Keeps the pixels cache line aligned
+} ShmRingFrame;
+
+/**
+ * A single producer, many consumer ring of results in POSIX shared memory.
+ * The producer never waits on consumers: each record and frame slot is a
+ * seqlock, so a consumer falling more than a ring behind sees the records
+ * it missed were overwritten instead of blocking or corrupting the writer.
+ */
+typedef struct {
+    char           name[NAME_MAX]; // Shared memory object, with leading /
+    int            fd;
+    void*          map;
+    size_t         size;
+    ShmRingHeader* header;
+    bool           owner;          // Created here, unlinked on close
+} ShmRing;
+
+/**
+ * Creates the shared memory object name, replacing any by that name, with
+ * records of up to max_faces faces and, when frame_size is not 0, frame
+ * slots carrying decoded frames of up to frame_size bytes.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+shm_ring_create(ShmRing*    ring,
+                const char* name,
+                size_t      max_faces,
+                size_t      frame_size);
+
+/**
+ * Maps the ring created under name by another process for reading.
+ *
+ * Returns 0 on success or -1 with errno set, EPROTO when name is not a ring
+ * of this version or not laid out yet.
+ */
+int
+shm_ring_attach(ShmRing* ring, const char* name);
+
+/**
+ * Publishes the results of job as the next record, with its frame when
+ * there are frame slots and it fits.  Faces beyond max_faces are dropped.
+ */
+void
+shm_ring_publish(ShmRing* ring, const Job* job);
+
+/**
+ * Number of the newest complete record, 0 before the first.
+ */
+uint64_t
+shm_ring_head(const ShmRing* ring);
+
+/**
+ * Copies record number into record, which must hold header->record_size
+ * bytes.
+ *
+ * Returns 0 on success or -1 with errno EAGAIN when the record is not
+ * published yet or EOVERFLOW when it was overwritten, the oldest record
+ * still available then being shm_ring_head() - slots + 1.
+ */
+int
+shm_ring_read(const ShmRing* ring, uint64_t number, ShmRingRecord* record);
+
+/**
+ * The frame_bytes pixels carried by record, read in place, or NULL when it
+ * carries none.  They may be overwritten while in use, shm_ring_frame_valid()
+ * tells afterwards whether they still belong to the record.
+ */
+const uint8_t*
+shm_ring_frame(const ShmRing* ring, const ShmRingRecord* record);
+
+/**
+ * Whether the pixels returned by shm_ring_frame() for record number were
+ * left untouched until now.
+ */
+bool
+shm_ring_frame_valid(const ShmRing*       ring,
+                     const ShmRingRecord* record,
+                     uint64_t             number);
+
+/**
+ * Unmaps ring, removing the shared memory object when it was created here.
+ */
+void
+shm_ring_close(ShmRing* ring);
+
+#endif /* SHMRING_H */
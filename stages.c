@@ -0,0 +1,1067 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "stages.h"
+#include "trace.h"
+
+// Runs the model of ctx once on a zeroed input so compiling and warming its
+// graph happens before the first image.  Returns the time it took, or -1
+// when the inference failed.
+static int64_t
+warm_up(VAALContext* ctx)
+{
+    NNTensor* input = vaal_input_tensor(ctx, 0);
+    if (!input) {
+        fprintf(stderr, "failed to warm up model: no input tensor\n");
+        return -1;
+    }
+    if (nn_tensor_fill(input, 0.0)) {
+        fprintf(stderr, "failed to warm up model: cannot clear its input\n");
+        return -1;
+    }
+
+    int64_t   start = vaal_clock_now();
+    VAALError err   = vaal_run_model(ctx);
+    if (err) {
+        fprintf(stderr, "failed to warm up model: %s\n", vaal_strerror(err));
+        return -1;
+    }
+    return vaal_clock_now() - start;
+}
+
+// Creates a head pose context on engine with its batch layout, crop loader
+// and, when requested, the thread running it, then warms the model up,
+// storing the time it took in first_ns when given.  Returns NULL after
+// reporting the failure on stderr, a model failing to warm up included.
+static PoseBatch*
+pose_open(const StagesConfig* config, const char* engine, int64_t* first_ns)
+{
+    VAALError err;
+
+    VAALContext* pose_ctx = vaal_context_create(engine);
+    err                   = vaal_load_model_file(pose_ctx, config->model);
+    if (err) {
+        fprintf(stderr, "failed to load model: %s\n", vaal_strerror(err));
+        vaal_context_release(pose_ctx);
+        return NULL;
+    }
+    vaal_parameter_seti(pose_ctx, "normalization", &config->norm, 1);
+
+    PoseBatch* pose = calloc(1, sizeof(PoseBatch));
+    if (!pose || pose_batch_init(pose, pose_ctx)) {
+        fprintf(stderr,
+                "failed to prepare head pose batch: %s\n",
+                strerror(errno));
+        if (pose) pose_batch_release(pose);
+        free(pose);
+        vaal_context_release(pose_ctx);
+        return NULL;
+    }
+
+    if (pose_batch_preprocess(pose,
+                              (PreprocessKernel) config->preprocess,
+                              config->norm)) {
+        if (errno != ENOTSUP) {
+            fprintf(stderr,
+                    "failed to prepare preprocessing: %s\n",
+                    strerror(errno));
+            pose_batch_release(pose);
+            vaal_context_release(pose_ctx);
+            free(pose);
+            return NULL;
+        }
+        fprintf(stderr,
+                "%s preprocessing does not support the head pose input, "
+                "using vaal\n",
+                preprocess_name((PreprocessKernel) config->preprocess));
+    }
+
+    if (config->pose_async && pose_batch_async(pose)) {
+        fprintf(stderr,
+                "failed to start head pose thread, running synchronously: "
+                "%s\n",
+                strerror(errno));
+    }
+
+    int64_t warm_ns = warm_up(pose_ctx);
+    if (warm_ns < 0) {
+        fprintf(stderr, "failed to run head pose model on %s\n", engine);
+        pose_batch_release(pose);
+        vaal_context_release(pose_ctx);
+        free(pose);
+        return NULL;
+    }
+    if (first_ns) *first_ns = warm_ns;
+
+    return pose;
+}
+
+// Creates a head pose context on every engine of the comma separated
+// config->pose_engines and shares the faces of each image between them and
+// stages->pose through a scheduler.
+static int
+pose_engines_open(Stages* stages, const StagesConfig* config)
+{
+    stages->scheduler = calloc(1, sizeof(PoseScheduler));
+    if (!stages->scheduler ||
+        pose_scheduler_init(stages->scheduler, stages->pose, config->engine)) {
+        fprintf(stderr,
+                "failed to create pose scheduler: %s\n",
+                strerror(errno));
+        free(stages->scheduler);
+        stages->scheduler = NULL;
+        return -1;
+    }
+
+    const char* engines = config->pose_engines;
+    while (*engines) {
+        size_t length = strcspn(engines, ",");
+        char   engine[32];
+
+        if (length == 0 || length >= sizeof(engine)) {
+            fprintf(stderr,
+                    "invalid pose engine list: %s\n",
+                    config->pose_engines);
+            return -1;
+        }
+        memcpy(engine, engines, length);
+        engine[length] = '\0';
+        engines += length + (engines[length] == ',');
+
+        PoseBatch* pose = pose_open(config, engine, NULL);
+        if (!pose) return -1;
+
+        if (pose_scheduler_add(stages->scheduler, pose, engine)) {
+            fprintf(stderr,
+                    "failed to add pose engine %s: %s\n",
+                    engine,
+                    strerror(errno));
+            VAALContext* pose_ctx = pose->ctx;
+            pose_batch_release(pose);
+            vaal_context_release(pose_ctx);
+            free(pose);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// The face detector being created beside the head pose context.
+typedef struct {
+    const StagesConfig* config;
+    VAALContext*        ctx;
+    int64_t             first_ns; // Warm-up inference
+} DetectorOpen;
+
+// Applies the NMS settings of config to the face detector faces_ctx.
+static void
+detector_params(VAALContext* faces_ctx, const StagesConfig* config)
+{
+    int faces_norm = 0;
+    // Set NMS parameters, values can be changed at start of main
+    vaal_parameter_seti(faces_ctx,
+                        "max_detection",
+                        &config->max_detection,
+                        1);
+    vaal_parameter_setf(faces_ctx, "score_threshold", &config->score_thr, 1);
+    vaal_parameter_setf(faces_ctx, "iou_threshold", &config->iou_thr, 1);
+    vaal_parameter_seti(faces_ctx, "normalization", &faces_norm, 1);
+}
+
+// Finds and loads the face detection model, through the probe cache, with
+// the NMS settings of config.
+static void*
+detector_open(void* arg)
+{
+    DetectorOpen*       open   = arg;
+    const StagesConfig* config = open->config;
+
+    VAALContext* faces_ctx = probe_cache_model(config->engine,
+                                               model_type_face_detection,
+                                               config->model);
+    if (faces_ctx) {
+        detector_params(faces_ctx, config);
+        open->first_ns = warm_up(faces_ctx);
+    }
+    open->ctx = faces_ctx;
+
+    return NULL;
+}
+
+// Loads the comma separated face detectors of config->detect_models after
+// stages->faces_ctx and has stages->adapt pick between them by latency.
+static int
+detectors_open(Stages* stages, const StagesConfig* config)
+{
+    size_t      levels = 1;
+    const char* models = config->detect_models;
+
+    stages->detectors[0] = stages->faces_ctx;
+    while (*models) {
+        size_t length = strcspn(models, ",");
+        char   path[PATH_MAX];
+
+        if (length == 0 || length >= sizeof(path) || levels == ADAPT_LEVELS) {
+            fprintf(stderr,
+                    "invalid face detection model list: %s\n",
+                    config->detect_models);
+            return -1;
+        }
+        memcpy(path, models, length);
+        path[length] = '\0';
+        models += length + (models[length] == ',');
+
+        VAALContext* ctx = vaal_context_create(config->engine);
+        if (!ctx) {
+            fprintf(stderr, "failed to create context: %s\n", path);
+            return -1;
+        }
+        stages->detectors[levels++] = ctx;
+
+        VAALError err = vaal_load_model_file(ctx, path);
+        if (err) {
+            fprintf(stderr,
+                    "failed to load model %s: %s\n",
+                    path,
+                    vaal_strerror(err));
+            return -1;
+        }
+        detector_params(ctx, config);
+        if (warm_up(ctx) < 0) {
+            fprintf(stderr, "failed to run face detection model %s\n", path);
+            return -1;
+        }
+    }
+
+    stages->adapt = calloc(1, sizeof(Adapt));
+    if (!stages->adapt) {
+        fprintf(stderr,
+                "failed to allocate adaptive detection: %s\n",
+                strerror(errno));
+        return -1;
+    }
+    adapt_init(stages->adapt, levels, config->latency_budget);
+
+    return 0;
+}
+
+int
+stages_open(Stages* stages, const StagesConfig* config)
+{
+    memset(stages, 0, sizeof(*stages));
+    stages->shared_frame  = config->shared_frame;
+    stages->max_detection = config->max_detection;
+    stages->roi_pad       = MAX(config->roi_pad, 0.0f);
+    stages->roi_square    = config->roi_square;
+
+    stages->open_ns       = vaal_clock_now();
+    stages->pose_warm_ns  = -1;
+    stages->faces_warm_ns = -1;
+
+    // Both models load at once, the face detector on a thread of its own.
+    DetectorOpen detector = {.config = config, .first_ns = -1};
+    pthread_t    thread;
+    bool         threaded = false;
+    if (config->face_detect) {
+        threaded = pthread_create(&thread, NULL, detector_open, &detector) == 0;
+        if (!threaded) detector_open(&detector);
+    }
+
+    stages->pose = pose_open(config, config->engine, &stages->pose_warm_ns);
+    if (threaded) pthread_join(thread, NULL);
+    stages->faces_ctx     = detector.ctx;
+    stages->faces_warm_ns = detector.first_ns;
+    if (!stages->pose) {
+        stages_close(stages);
+        return -1;
+    }
+    if (stages->faces_ctx && stages->faces_warm_ns < 0) {
+        fprintf(stderr, "failed to run face detection model\n");
+        stages_close(stages);
+        return -1;
+    }
+
+    if (config->pose_engines && pose_engines_open(stages, config)) {
+        stages_close(stages);
+        return -1;
+    }
+
+    if (stages->faces_ctx && config->detect_models &&
+        config->latency_budget > 0 && detectors_open(stages, config)) {
+        stages_close(stages);
+        return -1;
+    }
+
+    if (stages->faces_ctx && config->jpeg_scaled) {
+        NNTensor* input = vaal_input_tensor(stages->faces_ctx, 0);
+        if (input && nn_tensor_dims(input) == 4) {
+            const int32_t* shape  = nn_tensor_shape(input);
+            bool           planar = shape[1] == 3 && shape[3] != 3;
+
+            stages->jpeg_scaled   = true;
+            stages->detect_height = planar ? shape[2] : shape[1];
+            stages->detect_width  = planar ? shape[3] : shape[2];
+        }
+    }
+
+    if (stages->faces_ctx && config->detect_interval > 0) {
+        stages->tracker = calloc(1, sizeof(Tracker));
+        if (!stages->tracker ||
+            tracker_init(stages->tracker,
+                         config->max_detection,
+                         config->iou_thr,
+                         config->detect_interval)) {
+            fprintf(stderr,
+                    "failed to allocate tracker: %s\n",
+                    strerror(errno));
+            free(stages->tracker);
+            stages->tracker = NULL;
+            stages_close(stages);
+            return -1;
+        }
+    }
+
+    if (stages->faces_ctx && (config->min_face > 0 || config->top_k > 0 ||
+                              config->pose_budget > 0)) {
+        stages->gate = calloc(1, sizeof(FaceGate));
+        if (!stages->gate ||
+            face_gate_init(stages->gate,
+                           config->max_detection,
+                           config->min_face,
+                           (size_t) MAX(config->top_k, 0),
+                           config->top_k_area,
+                           config->pose_budget)) {
+            fprintf(stderr,
+                    "failed to allocate face gate: %s\n",
+                    strerror(errno));
+            free(stages->gate);
+            stages->gate = NULL;
+            stages_close(stages);
+            return -1;
+        }
+    }
+
+    if (stages->tracker && config->pose_cache) {
+        stages->pose_cache = calloc(1, sizeof(PoseCache));
+        if (!stages->pose_cache ||
+            pose_cache_init(stages->pose_cache,
+                            config->max_detection,
+                            config->pose_cache_thr,
+                            config->pose_cache_ttl)) {
+            fprintf(stderr,
+                    "failed to allocate pose cache: %s\n",
+                    strerror(errno));
+            free(stages->pose_cache);
+            stages->pose_cache = NULL;
+            stages_close(stages);
+            return -1;
+        }
+    }
+
+    stages->open_ns = vaal_clock_now() - stages->open_ns;
+    return 0;
+}
+
+int
+stages_graph_cache(const char* dir)
+{
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        fprintf(stderr,
+                "failed to create graph cache %s: %s\n",
+                dir,
+                strerror(errno));
+        return -1;
+    }
+    if (setenv(STAGES_GRAPH_CACHE_ENABLE, "1", 1) ||
+        setenv(STAGES_GRAPH_CACHE_DIR, dir, 1)) {
+        fprintf(stderr, "failed to enable graph cache: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void
+stages_print_startup(const Stages* stages, FILE* out)
+{
+    fprintf(out, "Startup: %.3f ms", stages->open_ns / 1e6);
+    if (stages->pose_warm_ns >= 0) {
+        fprintf(out, ", first head pose %.3f ms", stages->pose_warm_ns / 1e6);
+    }
+    if (stages->faces_warm_ns >= 0) {
+        fprintf(out,
+                ", first face detection %.3f ms",
+                stages->faces_warm_ns / 1e6);
+    }
+    fprintf(out, "\n");
+}
+
+void
+stages_close(Stages* stages)
+{
+    if (stages->pose_cache) {
+        pose_cache_release(stages->pose_cache);
+        free(stages->pose_cache);
+    }
+    if (stages->gate) {
+        face_gate_release(stages->gate);
+        free(stages->gate);
+    }
+    if (stages->tracker) {
+        tracker_release(stages->tracker);
+        free(stages->tracker);
+    }
+    for (size_t i = 1; i < ADAPT_LEVELS; i++) {
+        if (stages->detectors[i]) vaal_context_release(stages->detectors[i]);
+    }
+    free(stages->adapt);
+    if (stages->faces_ctx) vaal_context_release(stages->faces_ctx);
+    if (stages->scheduler) {
+        pose_scheduler_release(stages->scheduler);
+        free(stages->scheduler);
+    }
+    if (stages->pose) {
+        VAALContext* pose_ctx = stages->pose->ctx;
+        pose_batch_release(stages->pose);
+        vaal_context_release(pose_ctx);
+        free(stages->pose);
+    }
+    memset(stages, 0, sizeof(*stages));
+}
+
+int
+job_init(Job* job, size_t max_detection)
+{
+    size_t boxes        = max_detection * sizeof(VAALBox);
+    size_t rois         = max_detection * sizeof(*job->rois);
+    size_t orientations = max_detection * sizeof(VAALEuler);
+    size_t track_ids    = max_detection * sizeof(uint32_t);
+    size_t face_ns      = max_detection * sizeof(int64_t);
+    size_t skipped      = max_detection * sizeof(bool);
+
+    memset(job, 0, sizeof(*job));
+    if (arena_init(&job->arena,
+                   arena_size(boxes) + arena_size(rois) * 2 +
+                       arena_size(orientations) + arena_size(track_ids) +
+                       arena_size(face_ns) + arena_size(skipped))) {
+        return -1;
+    }
+
+    job->boxes        = arena_alloc(&job->arena, boxes);
+    job->rois         = arena_alloc(&job->arena, rois);
+    job->orientations = arena_alloc(&job->arena, orientations);
+    job->track_ids    = arena_alloc(&job->arena, track_ids);
+    job->pose.face_ns = arena_alloc(&job->arena, face_ns);
+    job->region_rois  = arena_alloc(&job->arena, rois);
+    job->skipped      = arena_alloc(&job->arena, skipped);
+
+    return 0;
+}
+
+void
+job_release(Job* job)
+{
+    frame_release(&job->frame);
+    frame_release(&job->region);
+    arena_release(&job->arena);
+    mapped_file_close(&job->file);
+    memset(job, 0, sizeof(*job));
+}
+
+void
+job_reset(const Stages* stages, Job* job)
+{
+    int64_t* face_ns = job->pose.face_ns;
+
+    job->start_ns       = vaal_clock_now();
+    job->num_boxes      = 0;
+    job->face_detect    = stages->faces_ctx != NULL;
+    job->detected       = false;
+    job->detector       = 0;
+    job->pose_cached    = 0;
+    job->pose_skipped   = 0;
+    job->decode_ns      = 0;
+    job->region_ns      = -1;
+    job->detect_load_ns = 0;
+    job->detect_run_ns  = 0;
+    job->boxes_ns       = 0;
+    job->pose           = (PoseTiming){.face_ns = face_ns};
+}
+
+// Moves the span [*lo, *lo + size) inside [0, limit), shrinking it only
+// when it is larger than the image.
+static void
+roi_fit(float* lo, float size, int32_t limit)
+{
+    if (size >= (float) limit) {
+        *lo = 0.0f;
+    } else {
+        *lo = CLAMP(*lo, 0.0f, (float) limit - size);
+    }
+}
+
+// Computes the pose crop of box in pixels of a width by height image with
+// the padding, square expansion and alignment of stages.  Without any the
+// box is only clamped to the image so in range boxes keep their crop.
+static void
+roi_from_box(const Stages*  stages,
+             const VAALBox* box,
+             int32_t        width,
+             int32_t        height,
+             int32_t*       roi)
+{
+    if (stages->roi_pad <= 0.0f && !stages->roi_square) {
+        roi[0] = CLAMP((int32_t) (box->xmin * (float) width), 0, width);
+        roi[1] = CLAMP((int32_t) (box->ymin * (float) height), 0, height);
+        roi[2] = CLAMP((int32_t) (box->xmax * (float) width), 0, width);
+        roi[3] = CLAMP((int32_t) (box->ymax * (float) height), 0, height);
+        return;
+    }
+
+    float cx = (box->xmin + box->xmax) * 0.5f * (float) width;
+    float cy = (box->ymin + box->ymax) * 0.5f * (float) height;
+    float w  = (box->xmax - box->xmin) * (float) width;
+    float h  = (box->ymax - box->ymin) * (float) height;
+
+    w *= 1.0f + 2.0f * stages->roi_pad;
+    h *= 1.0f + 2.0f * stages->roi_pad;
+    if (stages->roi_square) w = h = MAX(w, h);
+
+    // Crop widths are a multiple of ROI_ALIGN pixels so crop rows cover
+    // whole vectors, images narrower than that use their full width.
+    int32_t max_w = width >= ROI_ALIGN ? width / ROI_ALIGN * ROI_ALIGN : width;
+    w             = MAX(ROI_ALIGN, roundf(w / ROI_ALIGN) * ROI_ALIGN);
+    w             = MIN(w, (float) max_w);
+    h             = stages->roi_square ? w : roundf(h);
+    h             = CLAMP(h, 1.0f, (float) height);
+
+    float x0 = floorf(cx - w * 0.5f);
+    float y0 = floorf(cy - h * 0.5f);
+    roi_fit(&x0, w, width);
+    roi_fit(&y0, h, height);
+
+    roi[0] = (int32_t) x0;
+    roi[1] = (int32_t) y0;
+    roi[2] = (int32_t) (x0 + w);
+    roi[3] = (int32_t) (y0 + h);
+}
+
+// Computes the pose crop of every box in pixels of the job image, once for
+// the crop loaders, the face gate and the output.
+static void
+job_rois(const Stages* stages, Job* job)
+{
+    // Crops for every face are gathered first so the pose model can run
+    // them together when its input has a batch dimension.
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        roi_from_box(stages,
+                     &job->boxes[j],
+                     job->width,
+                     job->height,
+                     job->rois[j]);
+    }
+}
+
+// Decodes the encoded image at data into job->frame, JPEG streams reduced
+// for the detector when stages->jpeg_scaled is set.  PNG images and JPEG
+// streams otherwise are decoded at full resolution.
+static int
+job_decode(const Stages* stages, Job* job, const uint8_t* data, size_t size)
+{
+    job->encoded      = NULL;
+    job->encoded_size = 0;
+
+    if (stages->jpeg_scaled && frame_is_jpeg(data, size)) {
+        if (frame_load_jpeg_scaled(&job->frame,
+                                   data,
+                                   size,
+                                   stages->detect_width,
+                                   stages->detect_height,
+                                   &job->width,
+                                   &job->height)) {
+            return -1;
+        }
+        if (job->frame.width != job->width) {
+            job->encoded      = data;
+            job->encoded_size = size;
+        }
+        return 0;
+    }
+
+    if (frame_load_memory(&job->frame, data, size)) return -1;
+    job->width  = job->frame.width;
+    job->height = job->frame.height;
+    return 0;
+}
+
+// Decodes the region around every face of a job whose frame was reduced at
+// full resolution into job->region, and the crops relative to it.  Faces
+// the gate skipped do not widen the region.
+static int
+job_decode_faces(Job* job)
+{
+    int32_t roi[4] = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+    int32_t origin[2];
+    int64_t start = vaal_clock_now();
+
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        if (job->pose_skipped && job->skipped[j]) continue;
+        roi[0] = MIN(roi[0], job->rois[j][0]);
+        roi[1] = MIN(roi[1], job->rois[j][1]);
+        roi[2] = MAX(roi[2], job->rois[j][2]);
+        roi[3] = MAX(roi[3], job->rois[j][3]);
+    }
+
+    if (frame_load_jpeg_region(&job->region,
+                               job->encoded,
+                               job->encoded_size,
+                               roi,
+                               origin)) {
+        fprintf(stderr, "failed to load %s: %s\n", job->path, frame_error());
+        return -1;
+    }
+
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        job->region_rois[j][0] = job->rois[j][0] - origin[0];
+        job->region_rois[j][1] = job->rois[j][1] - origin[1];
+        job->region_rois[j][2] = job->rois[j][2] - origin[0];
+        job->region_rois[j][3] = job->rois[j][3] - origin[1];
+    }
+
+    // Benchmarks time the decode of the image once, outside the job.
+    job->region_ns = vaal_clock_now() - start;
+    if (job->decode_ns >= 0) job->decode_ns += job->region_ns;
+    trace_span("decode_faces", start, start + job->region_ns);
+    return 0;
+}
+
+int
+stage_decode(const Stages* stages, Job* job)
+{
+    job_reset(stages, job);
+
+    if (stages->jpeg_scaled) {
+        // The mapping is kept until the next image so stage_pose() can
+        // decode the faces from it again.
+        mapped_file_close(&job->file);
+        if (mapped_file_open(&job->file, job->path)) {
+            fprintf(stderr,
+                    "failed to load %s: %s\n",
+                    job->path,
+                    strerror(errno));
+            return -1;
+        }
+        if (job_decode(stages, job, job->file.data, job->file.size)) {
+            fprintf(stderr,
+                    "failed to load %s: %s\n",
+                    job->path,
+                    frame_error());
+            return -1;
+        }
+    } else if (stages->shared_frame) {
+        // Decode once, the detector and every face crop are loaded from
+        // this frame rather than from the file.
+        if (frame_load_file(&job->frame, job->path)) {
+            fprintf(stderr,
+                    "failed to load %s: %s\n",
+                    job->path,
+                    frame_error());
+            return -1;
+        }
+        job->width  = job->frame.width;
+        job->height = job->frame.height;
+    } else if (stages->faces_ctx) {
+        // Boxes only need the resolution, read from the header alone.
+        if (frame_probe_file(job->path, &job->width, &job->height)) {
+            fprintf(stderr,
+                    "failed to load %s: %s\n",
+                    job->path,
+                    frame_error());
+            return -1;
+        }
+    }
+
+    job->decode_ns = vaal_clock_now() - job->start_ns;
+    trace_span("decode", job->start_ns, job->start_ns + job->decode_ns);
+    return 0;
+}
+
+int
+stage_decode_memory(const Stages*  stages,
+                    Job*           job,
+                    const uint8_t* data,
+                    size_t         size)
+{
+    job_reset(stages, job);
+    mapped_file_close(&job->file);
+
+    if (job_decode(stages, job, data, size)) {
+        fprintf(stderr, "failed to load %s: %s\n", job->path, frame_error());
+        return -1;
+    }
+    job->decode_ns = vaal_clock_now() - job->start_ns;
+    trace_span("decode", job->start_ns, job->start_ns + job->decode_ns);
+
+    return 0;
+}
+
+int
+stage_detect(const Stages* stages, Job* job)
+{
+    VAALError    err;
+    VAALContext* ctx = stages->faces_ctx;
+    int64_t      start;
+
+    if (!ctx) return 0;
+    if (stages->adapt) {
+        job->detector = adapt_level(stages->adapt);
+        ctx           = stages->detectors[job->detector];
+    }
+
+    if (stages->tracker && !tracker_wants_detection(stages->tracker)) {
+        start          = vaal_clock_now();
+        job->num_boxes = tracker_predict(stages->tracker,
+                                         job->boxes,
+                                         job->track_ids);
+        job->boxes_ns  = vaal_clock_now() - start;
+        trace_span("track_predict", start, start + job->boxes_ns);
+        job_rois(stages, job);
+        return 0;
+    }
+
+    start = vaal_clock_now();
+    if (stages->shared_frame) {
+        err = frame_load_tensor(ctx, NULL, &job->frame, NULL);
+    } else {
+        err = vaal_load_image_file(ctx, NULL, job->path, NULL, 0);
+    }
+    job->detect_load_ns = vaal_clock_now() - start;
+    trace_span("detect_load", start, start + job->detect_load_ns);
+    if (err) {
+        fprintf(stderr,
+                "failed to load %s: %s\n",
+                job->path,
+                vaal_strerror(err));
+        return -1;
+    }
+
+    start              = vaal_clock_now();
+    err                = vaal_run_model(ctx);
+    job->detect_run_ns = vaal_clock_now() - start;
+    trace_span("detect_run", start, start + job->detect_run_ns);
+    if (err) {
+        fprintf(stderr, "failed to run model: %s\n", vaal_strerror(err));
+        return -1;
+    }
+
+    start = vaal_clock_now();
+    err   = vaal_boxes(ctx, job->boxes, stages->max_detection, &job->num_boxes);
+    if (!err && stages->tracker) {
+        tracker_update(stages->tracker,
+                       job->boxes,
+                       job->num_boxes,
+                       job->track_ids);
+    }
+    job->boxes_ns = vaal_clock_now() - start;
+    trace_span_arg("vaal_boxes",
+                   start,
+                   start + job->boxes_ns,
+                   "faces",
+                   (int64_t) job->num_boxes);
+    if (err) {
+        fprintf(stderr, "Face box decode failed.\n");
+        return -1;
+    }
+    job->detected = true;
+
+    job_rois(stages, job);
+    return 0;
+}
+
+// Estimates count faces on stages->pose, or shared over the engines of the
+// scheduler when there is one.
+static VAALError
+stage_pose_run(const Stages* stages,
+               const Frame*  frame,
+               const char*   path,
+               int32_t       (*rois)[4],
+               size_t        count,
+               VAALEuler*    orientations,
+               PoseTiming*   timing)
+{
+    if (stages->scheduler) {
+        return pose_scheduler_run(stages->scheduler,
+                                  frame,
+                                  path,
+                                  rois,
+                                  count,
+                                  orientations,
+                                  timing);
+    }
+    return pose_batch_run(stages->pose,
+                          frame,
+                          path,
+                          rois,
+                          count,
+                          orientations,
+                          timing);
+}
+
+// Estimates the faces of job missing from the pose cache, or whose crop
+// changed, in one stage_pose_run() and caches their new poses.  The crops
+// are the rois of frame.
+static int
+stage_pose_cached(const Stages* stages,
+                  Job*          job,
+                  const Frame*  frame,
+                  int32_t       (*rois)[4])
+{
+    PoseCache* cache  = stages->pose_cache;
+    PoseTiming timing = {.face_ns = cache->face_ns};
+    size_t     count  = 0;
+
+    cache->frame++;
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        if (job->pose_skipped && job->skipped[j]) continue;
+
+        int64_t  start = vaal_clock_now();
+        uint32_t id    = job->track_ids[j];
+        uint8_t* thumb = cache->thumbs[count];
+
+        // Untracked faces cannot be matched with a previous pose.
+        cache->has_thumb[count] =
+            id && frame_thumbnail(frame, rois[j], thumb) == 0;
+        if (cache->has_thumb[count] &&
+            pose_cache_lookup(cache, id, thumb, &job->orientations[j])) {
+            job->pose.face_ns[j] = vaal_clock_now() - start;
+            trace_span_arg("pose_cached",
+                           start,
+                           start + job->pose.face_ns[j],
+                           "face",
+                           (int64_t) j);
+            job->pose_cached++;
+            continue;
+        }
+
+        memcpy(cache->rois[count], rois[j], sizeof(*cache->rois));
+        cache->faces[count++] = j;
+    }
+
+    if (count) {
+        VAALError err = stage_pose_run(stages,
+                                       frame,
+                                       job->path,
+                                       cache->rois,
+                                       count,
+                                       cache->results,
+                                       &timing);
+        if (err) {
+            fprintf(stderr,
+                    "failed to estimate head pose for %s: %s\n",
+                    job->path,
+                    vaal_strerror(err));
+            return -1;
+        }
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        size_t j             = cache->faces[k];
+        job->orientations[j] = cache->results[k];
+        job->pose.face_ns[j] = cache->face_ns[k];
+        if (cache->has_thumb[k]) {
+            pose_cache_store(cache,
+                             job->track_ids[j],
+                             cache->thumbs[k],
+                             &cache->results[k]);
+        }
+    }
+
+    job->pose.load_ns      = timing.load_ns;
+    job->pose.inference_ns = timing.inference_ns;
+    job->pose.euler_ns     = timing.euler_ns;
+
+    return 0;
+}
+
+// Estimates the faces of job the gate kept, gathered so they still go
+// through one stage_pose_run().  The crops are the rois of frame.
+static int
+stage_pose_gated(const Stages* stages,
+                 Job*          job,
+                 const Frame*  frame,
+                 int32_t       (*rois)[4])
+{
+    FaceGate*  gate   = stages->gate;
+    PoseTiming timing = {.face_ns = gate->times};
+    size_t     count  = 0;
+
+    for (size_t j = 0; j < job->num_boxes; j++) {
+        if (job->skipped[j]) continue;
+        memcpy(gate->rois[count], rois[j], sizeof(*gate->rois));
+        gate->faces[count++] = j;
+    }
+
+    VAALError err = stage_pose_run(stages,
+                                   frame,
+                                   job->path,
+                                   gate->rois,
+                                   count,
+                                   gate->results,
+                                   &timing);
+    if (err) {
+        fprintf(stderr,
+                "failed to estimate head pose for %s: %s\n",
+                job->path,
+                vaal_strerror(err));
+        return -1;
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        size_t j             = gate->faces[k];
+        job->orientations[j] = gate->results[k];
+        job->pose.face_ns[j] = gate->times[k];
+    }
+
+    job->pose.load_ns      = timing.load_ns;
+    job->pose.inference_ns = timing.inference_ns;
+    job->pose.euler_ns     = timing.euler_ns;
+
+    return 0;
+}
+
+int
+stage_pose(const Stages* stages, Job* job)
+{
+    VAALError    err;
+    VAALContext* ctx   = stages->pose->ctx;
+    const Frame* frame = stages->shared_frame ? &job->frame : NULL;
+    int32_t      (*rois)[4] = job->rois;
+    int64_t      start;
+
+    if (stages->gate && job->num_boxes) {
+        job->pose_skipped = face_gate_select(stages->gate,
+                                             job->boxes,
+                                             job->rois,
+                                             job->num_boxes,
+                                             job->skipped);
+        for (size_t j = 0; j < job->num_boxes; j++) {
+            if (!job->skipped[j]) continue;
+            job->orientations[j] = (VAALEuler){0};
+            job->pose.face_ns[j] = 0;
+        }
+    }
+
+    // A reduced frame only served the detector, the faces kept by the gate
+    // are decoded again at full resolution.
+    if (job->encoded && job->num_boxes > job->pose_skipped) {
+        if (job_decode_faces(job)) return -1;
+        frame = &job->region;
+        rois  = job->region_rois;
+    }
+
+    if (stages->faces_ctx && stages->pose_cache && job->frame.data) {
+        if (stage_pose_cached(stages, job, frame, rois)) return -1;
+    } else if (job->pose_skipped) {
+        if (stage_pose_gated(stages, job, frame, rois)) return -1;
+    } else if (stages->faces_ctx) {
+        err = stage_pose_run(stages,
+                             frame,
+                             job->path,
+                             rois,
+                             job->num_boxes,
+                             job->orientations,
+                             &job->pose);
+        if (err) {
+            fprintf(stderr,
+                    "failed to estimate head pose for %s: %s\n",
+                    job->path,
+                    vaal_strerror(err));
+            return -1;
+        }
+    }
+
+    if (stages->faces_ctx) {
+        // Reused poses cost next to nothing and say nothing of the budget.
+        if (stages->gate) {
+            face_gate_update(stages->gate,
+                             &job->pose,
+                             job->num_boxes - job->pose_skipped -
+                                 job->pose_cached);
+        }
+        // Tracked frames say nothing of what the detector costs.
+        if (stages->adapt) {
+            adapt_update(stages->adapt,
+                         job->detector,
+                         vaal_clock_now() - job->start_ns,
+                         job->detected ? job->detect_load_ns +
+                                             job->detect_run_ns +
+                                             job->boxes_ns
+                                       : -1);
+        }
+        return 0;
+    }
+
+    start = vaal_clock_now();
+    if (stages->shared_frame) {
+        err = frame_load_tensor(ctx, NULL, &job->frame, NULL);
+    } else {
+        err = vaal_load_image_file(ctx, NULL, job->path, NULL, 0);
+    }
+    job->pose.load_ns = vaal_clock_now() - start;
+    trace_span("pose_load", start, start + job->pose.load_ns);
+    if (err) {
+        fprintf(stderr,
+                "failed to load %s: %s\n",
+                job->path,
+                vaal_strerror(err));
+        return -1;
+    }
+
+    start                  = vaal_clock_now();
+    err                    = vaal_run_model(ctx);
+    job->pose.inference_ns = vaal_clock_now() - start;
+    trace_span("pose_run", start, start + job->pose.inference_ns);
+    if (err) {
+        fprintf(stderr, "failed to run model: %s\n", vaal_strerror(err));
+        return -1;
+    }
+
+    // Decode into the batch scratch which is sized for every element the
+    // model may return, only the first is the full image.
+    size_t num_orientations = 0;
+    start                   = vaal_clock_now();
+    if (vaal_euler(ctx, stages->pose->results, &num_orientations)) {
+        fprintf(stderr, "Head pose decode failed.\n");
+        return -1;
+    }
+    job->pose.euler_ns   = vaal_clock_now() - start;
+    trace_span("vaal_euler", start, start + job->pose.euler_ns);
+    job->orientations[0] = stages->pose->results[0];
+    job->pose.face_ns[0] =
+        job->pose.load_ns + job->pose.inference_ns + job->pose.euler_ns;
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "adapt.h"
+#include "arena.h"
+#include "frame.h"
+#include "gate.h"
+#include "mapfile.h"
+#include "pose.h"
+#include "posecache.h"
+#include "probecache.h"
+#include "scheduler.h"
+#include "tracker.h"
+#include "vaal.h"
+
+// Environment of the VeriSilicon NPU driver caching compiled graphs.
+#define STAGES_GRAPH_CACHE_ENABLE "VIV_VX_ENABLE_CACHE_GRAPH_BINARY"
+#define STAGES_GRAPH_CACHE_DIR "VIV_VX_CACHE_BINARY_GRAPH_DIR"
+
+// Multiple in pixels the width of padded or square crops is rounded to.
+#define ROI_ALIGN 4
+
+/**
+ * The settings used to create the contexts of a Stages instance.
+ */
+typedef struct {
+    const char* engine;          // Compute engine for both models
+    const char* model;           // Head pose model file
+    int         norm;            // Head pose input normalization
+    bool        face_detect;     // Probe for a face detection model
+    bool        shared_frame;    // Decode into frame instead of reloading file
+    int         max_detection;   // Maximum faces per image
+    float       score_thr;       // Face detection score threshold
+    float       iou_thr;         // Face detection NMS IoU threshold
+    int         detect_interval; // Track faces detecting every N frames, or 0
+    bool        pose_cache;      // Reuse poses of unchanged tracked faces
+    int         pose_cache_thr;  // Mean thumbnail difference still unchanged
+    int         pose_cache_ttl;  // Frames a cached pose may be used for
+    int         preprocess;      // Resolved PreprocessKernel loading crops
+    bool        jpeg_scaled;     // Decode JPEG reduced to the detector input
+    const char* pose_engines;    // More engines sharing the faces, or NULL
+    bool        pose_async;      // Load crops while the head pose model runs
+    int32_t     min_face;        // Skip faces with a crop side below, or 0
+    int         top_k;           // Estimate at most N faces per frame, or 0
+    bool        top_k_area;      // Rank faces for top_k by area, not score
+    double      pose_budget;     // Head pose milliseconds per frame, or 0
+    float       roi_pad;         // Crop padding per side, fraction of the box
+    bool        roi_square;      // Expand crops to squares
+    const char* detect_models;   // Cheaper face detectors, or NULL
+    double      latency_budget;  // Frame latency to adapt to in ms, 0 for off
+} StagesConfig;
+
+/**
+ * The contexts and settings shared by every image going through the
+ * decode, detect and pose stages.
+ */
+typedef struct {
+    VAALContext*   faces_ctx;     // Face detector or NULL for full image pose
+    PoseBatch*     pose;          // Head pose model and its batch layout
+    bool           shared_frame;  // Decode into frame instead of reloading file
+    size_t         max_detection; // Capacity of the per-job result arrays
+    Tracker*       tracker;       // Faces followed across frames or NULL
+    PoseCache*     pose_cache;    // Poses of tracked faces or NULL
+    bool           jpeg_scaled;   // Decode JPEG reduced, faces at full size
+    int32_t        detect_width;  // Smallest reduced frame for the detector
+    int32_t        detect_height;
+    PoseScheduler* scheduler;     // Shares faces over more engines or NULL
+    FaceGate*      gate;          // Skips faces not worth a pose or NULL
+    float          roi_pad;       // Crop padding per side, fraction of the box
+    bool           roi_square;    // Expand crops to squares
+    int64_t        open_ns;       // Creating and warming up every context
+    int64_t        pose_warm_ns;  // First head pose inference or -1
+    int64_t        faces_warm_ns; // First face detection or -1
+    Adapt*         adapt;         // Picks the detector per frame or NULL
+    VAALContext*   detectors[ADAPT_LEVELS]; // faces_ctx, then cheaper ones
+} Stages;
+
+/**
+ * The state of a single image as it moves through the stages.
+ */
+typedef struct {
+    char           path[PATH_MAX];
+    Frame          frame;
+    int32_t        width;
+    int32_t        height;
+    size_t         num_boxes;
+    VAALBox*       boxes;
+    int32_t        (*rois)[4];     // Pose crop of every box, in pixels
+    VAALEuler*     orientations;
+    uint32_t*      track_ids;      // Track of every box, 0 when not tracking
+    bool           face_detect;    // Results are per detected face
+    bool           detected;       // The face detector ran, boxes not predicted
+    size_t         detector;       // Adaptive level of the detector that ran
+    size_t         pose_cached;    // Faces whose pose was reused from the cache
+    size_t         pose_skipped;   // Faces turned down by the face gate
+    bool*          skipped;        // Per box, valid when pose_skipped is set
+    int64_t        start_ns;       // Clock when the job entered stage_decode()
+    int64_t        decode_ns;      // Decoding the frame or probing resolution
+    int64_t        region_ns;      // Decoding region, -1 without one
+    int64_t        detect_load_ns; // Loading the image into the detector
+    int64_t        detect_run_ns;  // Running the face detector
+    int64_t        boxes_ns;       // Decoding boxes including NMS
+    PoseTiming     pose;           // Head pose steps and per face totals
+    Arena          arena;          // Holds the per face arrays above
+    // JPEG stream of a frame decoded reduced for the detector, NULL when the
+    // frame has the full resolution.  The faces are then decoded again into
+    // region, a full resolution crop around all of them.
+    const uint8_t* encoded;
+    size_t         encoded_size;
+    Frame          region;
+    int32_t        (*region_rois)[4]; // rois relative to region
+    MappedFile     file;              // Mapping of path backing encoded
+} Job;
+
+/**
+ * Creates the head pose context and, when requested and a face detection
+ * model is found through VAAL_MODEL_PATH, the face detection context, both
+ * at the same time and the latter through probe_cache_model().  A missing
+ * face detection model leaves stages->faces_ctx NULL.  Every model runs once
+ * on a zeroed input right after loading, which is when the NPU compiles its
+ * graph, so the first image is not charged for it, and a model failing to
+ * run fails here.  With a detector and config->jpeg_scaled, JPEG images are
+ * decoded at the smallest scale still covering the detector input and only
+ * the faces at full size for the head pose model.  Faces are tracked when
+ * config->detect_interval is set and there is a detector, which requires the
+ * images to go through stage_detect() in order, and their poses cached when
+ * config->pose_cache is set too.  The comma separated config->pose_engines,
+ * such as "cpu,cpu", add head pose contexts on those engines which the faces
+ * of an image are shared with.  With a detector, config->min_face, top_k and
+ * pose_budget gate which faces get a head pose inference.  Face crops are
+ * clamped to the image, padded by config->roi_pad and expanded to squares
+ * with config->roi_square.  The comma separated face detection models of
+ * config->detect_models, cheaper in the order given, are loaded next to the
+ * detector and with config->latency_budget chosen between per frame to keep
+ * the frame latency within it.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+stages_open(Stages* stages, const StagesConfig* config);
+
+/**
+ * Makes the NPU driver keep the graphs it compiles for the models in dir,
+ * created when missing, so later processes skip compiling them.  Must be
+ * called before stages_open().
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+stages_graph_cache(const char* dir);
+
+/**
+ * Prints how long creating the contexts and the warm-up inference of each
+ * model took, kept apart from the steady state timings.
+ */
+void
+stages_print_startup(const Stages* stages, FILE* out);
+
+/**
+ * Releases the contexts created by stages_open().
+ */
+void
+stages_close(Stages* stages);
+
+/**
+ * Allocates the result arrays of job for up to max_detection faces, all
+ * from one arena so processing images never allocates them again.  Decoded
+ * frames keep their pixel buffers from image to image, only growing them
+ * for a larger one, so only the decoders allocate their working memory.
+ *
+ * Returns 0 on success or -1 when out of memory.
+ */
+int
+job_init(Job* job, size_t max_detection);
+
+/**
+ * Releases the frame and result arrays held by job.
+ */
+void
+job_release(Job* job);
+
+/**
+ * Clears the results and timings of job and restarts its latency clock,
+ * keeping its path and decoded frame.  Called by stage_decode().
+ */
+void
+job_reset(const Stages* stages, Job* job);
+
+/**
+ * Decodes job->path into job->frame when frames are shared, otherwise only
+ * probes the resolution the detector boxes are scaled to.  JPEG images are
+ * decoded reduced when stages->jpeg_scaled is set.
+ *
+ * Each stage returns 0 on success or -1 after reporting the failure on
+ * stderr.
+ */
+int
+stage_decode(const Stages* stages, Job* job);
+
+/**
+ * Decodes the size bytes of encoded image at data into job->frame, as
+ * stage_decode() does for job->path.  Requires stages->shared_frame since
+ * there is no file to reload.
+ */
+int
+stage_decode_memory(const Stages*  stages,
+                    Job*           job,
+                    const uint8_t* data,
+                    size_t         size);
+
+/**
+ * Runs the face detector and computes the pose ROI of every box.  When
+ * tracking, boxes are predicted from the tracks instead on frames the
+ * tracker does not need to detect.  Does nothing when face detection is
+ * disabled.
+ */
+int
+stage_detect(const Stages* stages, Job* job);
+
+/**
+ * Estimates the head pose of every face found by stage_detect(), or of the
+ * whole image when face detection is disabled.  With a pose cache and a
+ * shared frame, tracked faces whose crop did not change reuse their pose.
+ */
+int
+stage_pose(const Stages* stages, Job* job);
+
+#endif /* STAGES_H */
@@ -0,0 +1,223 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <string.h>
+
+#include "stats.h"
+#include "trace.h"
+
+#define SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+static const char* stage_names[STAT_COUNT] = {
+    [STAT_DECODE]       = "decode",
+    [STAT_DECODE_FACES] = "decode_faces",
+    [STAT_DETECT_LOAD]  = "detect_load",
+    [STAT_DETECT_RUN]   = "detect_run",
+    [STAT_BOXES]        = "boxes",
+    [STAT_POSE_LOAD]    = "pose_load",
+    [STAT_POSE_RUN]     = "pose_run",
+    [STAT_EULER]        = "euler",
+    [STAT_FACE]         = "face",
+    [STAT_OUTPUT]       = "output",
+    [STAT_FRAME]        = "frame",
+    [STAT_CROP_FILE]    = "crop_file",
+    [STAT_CROP_FRAME]   = "crop_frame",
+    [STAT_CROP_KERNEL]  = "crop_kernel",
+    [STAT_PROBE_VAAL]   = "probe_vaal",
+    [STAT_PROBE_HEADER] = "probe_header",
+};
+
+// Values below SUB_COUNT map one to one, above that each power of two is
+// split into SUB_COUNT equal buckets.
+static int
+bucket_of(int64_t ns)
+{
+    uint64_t value = ns > 0 ? (uint64_t) ns : 0;
+    if (value < SUB_COUNT) return (int) value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift    = exponent - HISTOGRAM_SUB_BITS;
+    int index    = ((shift + 1) << HISTOGRAM_SUB_BITS) +
+                (int) ((value >> shift) & (SUB_COUNT - 1));
+
+    return MIN(index, HISTOGRAM_BUCKETS - 1);
+}
+
+// Returns the midpoint of the range covered by bucket index.
+static int64_t
+bucket_value(int index)
+{
+    if (index < SUB_COUNT) return index;
+
+    int      shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t low   = ((uint64_t) (SUB_COUNT + (index & (SUB_COUNT - 1))))
+                   << shift;
+
+    return (int64_t) (low + ((1ull << shift) >> 1));
+}
+
+void
+histogram_add(Histogram* histogram, int64_t ns)
+{
+    histogram->count++;
+    histogram->sum += ns;
+    if (ns > histogram->max) histogram->max = ns;
+    histogram->buckets[bucket_of(ns)]++;
+}
+
+int64_t
+histogram_percentile(const Histogram* histogram, double p)
+{
+    if (!histogram->count) return 0;
+
+    uint64_t rank = (uint64_t) (p * (double) histogram->count + 0.5);
+    uint64_t seen = 0;
+    rank          = CLAMP(rank, 1, histogram->count);
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) return MIN(bucket_value(i), histogram->max);
+    }
+
+    return histogram->max;
+}
+
+void
+stats_init(Stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->start_ns = vaal_clock_now();
+}
+
+void
+stats_add_job(Stats* stats, const Job* job, int64_t output_ns)
+{
+    Histogram* h = stats->stages;
+
+    // The first image warms up every buffer, later ones should not need
+    // the heap at all.
+    stats->allocs_last = alloc_count();
+    if (!stats->images) stats->allocs_first = stats->allocs_last;
+    stats->images++;
+    if (job->decode_ns >= 0) histogram_add(&h[STAT_DECODE], job->decode_ns);
+    if (job->region_ns >= 0) {
+        histogram_add(&h[STAT_DECODE_FACES], job->region_ns);
+    }
+    if (job->face_detect) {
+        stats->faces += job->num_boxes;
+        stats->pose_cached += job->pose_cached;
+        stats->pose_skipped += job->pose_skipped;
+        // Frames with tracked boxes skip the detector entirely.
+        if (job->detected) {
+            histogram_add(&h[STAT_DETECT_LOAD], job->detect_load_ns);
+            histogram_add(&h[STAT_DETECT_RUN], job->detect_run_ns);
+        }
+        histogram_add(&h[STAT_BOXES], job->boxes_ns);
+        for (size_t j = 0; j < job->num_boxes; j++) {
+            if (job->pose_skipped && job->skipped[j]) continue;
+            histogram_add(&h[STAT_FACE], job->pose.face_ns[j]);
+        }
+    } else {
+        stats->faces++;
+        histogram_add(&h[STAT_FACE], job->pose.face_ns[0]);
+    }
+    // Nothing ran when no face was found or every face reused its cached
+    // pose or was skipped, the whole image always runs without a detector.
+    size_t spared = job->pose_cached + job->pose_skipped;
+    if (job->face_detect ? job->num_boxes > spared : true) {
+        histogram_add(&h[STAT_POSE_LOAD], job->pose.load_ns);
+        histogram_add(&h[STAT_POSE_RUN], job->pose.inference_ns);
+        histogram_add(&h[STAT_EULER], job->pose.euler_ns);
+    }
+    int64_t now = vaal_clock_now();
+    if (output_ns >= 0) {
+        histogram_add(&h[STAT_OUTPUT], output_ns);
+        trace_span("output", now - output_ns, now);
+    }
+    histogram_add(&h[STAT_FRAME], now - job->start_ns);
+    trace_span_arg("frame", job->start_ns, now, "image",
+                   (int64_t) stats->images - 1);
+}
+
+const char*
+stats_stage_name(StatStage stage)
+{
+    return stage_names[stage];
+}
+
+double
+stats_seconds(const Stats* stats)
+{
+    if (stats->elapsed_ns) return stats->elapsed_ns / 1e9;
+    return (vaal_clock_now() - stats->start_ns) / 1e9;
+}
+
+void
+stats_print(const Stats* stats, FILE* out)
+{
+    double seconds = stats_seconds(stats);
+
+    fprintf(out,
+            "Summary: %llu images %llu faces in %.3f s, "
+            "%.2f images/sec %.2f faces/sec\n",
+            (unsigned long long) stats->images,
+            (unsigned long long) stats->faces,
+            seconds,
+            seconds > 0 ? stats->images / seconds : 0.0,
+            seconds > 0 ? stats->faces / seconds : 0.0);
+    // Counting allocations is only built in with ALLOC_STATS.
+    if (stats->allocs_last && stats->images > 1) {
+        fprintf(out,
+                "Allocations: %.2f per image after the first\n",
+                (double) (stats->allocs_last - stats->allocs_first) /
+                    (stats->images - 1));
+    }
+    if (stats->pose_cached) {
+        fprintf(out,
+                "Pose cache: %llu of %llu faces reused\n",
+                (unsigned long long) stats->pose_cached,
+                (unsigned long long) stats->faces);
+    }
+    if (stats->pose_skipped) {
+        fprintf(out,
+                "Face gate: %llu of %llu faces skipped\n",
+                (unsigned long long) stats->pose_skipped,
+                (unsigned long long) stats->faces);
+    }
+    fprintf(out,
+            "  %-12s %8s %10s %10s %10s %10s (ms)\n",
+            "stage",
+            "count",
+            "p50",
+            "p90",
+            "p99",
+            "max");
+
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram* h = &stats->stages[i];
+        if (!h->count) continue;
+        fprintf(out,
+                "  %-12s %8llu %10.4f %10.4f %10.4f %10.4f\n",
+                stage_names[i],
+                (unsigned long long) h->count,
+                histogram_percentile(h, 0.50) / 1e6,
+                histogram_percentile(h, 0.90) / 1e6,
+                histogram_percentile(h, 0.99) / 1e6,
+                h->max / 1e6);
+    }
+}
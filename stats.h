@@ -0,0 +1,129 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stages.h"
+
+// Sub-buckets per power of two, bounds the percentile error to about 3%.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/**
+ * A log-linear latency histogram in nanoseconds, constant in size however
+ * many samples are recorded.
+ */
+typedef struct {
+    uint64_t count;
+    int64_t  sum;
+    int64_t  max;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+/**
+ * The stages reported in the summary.  Face is sampled once per face, the
+ * others once per image.  The crop stages are only sampled by the benchmark,
+ * once per face, to compare the ways of loading a head pose crop, and the
+ * probe stages once per image to compare the ways of reading its size.
+ */
+typedef enum {
+    STAT_DECODE = 0,
+    STAT_DECODE_FACES,
+    STAT_DETECT_LOAD,
+    STAT_DETECT_RUN,
+    STAT_BOXES,
+    STAT_POSE_LOAD,
+    STAT_POSE_RUN,
+    STAT_EULER,
+    STAT_FACE,
+    STAT_OUTPUT,
+    STAT_FRAME,
+    STAT_CROP_FILE,
+    STAT_CROP_FRAME,
+    STAT_CROP_KERNEL,
+    STAT_PROBE_VAAL,
+    STAT_PROBE_HEADER,
+    STAT_COUNT,
+} StatStage;
+
+/**
+ * Per-stage latency distributions and throughput of a run.
+ */
+typedef struct {
+    Histogram stages[STAT_COUNT];
+    uint64_t  images;
+    uint64_t  faces;
+    uint64_t  pose_cached; // Faces whose pose was reused from the cache
+    uint64_t  pose_skipped; // Faces turned down by the face gate
+    uint64_t  allocs_first; // alloc_count() once the first image completed
+    uint64_t  allocs_last;  // alloc_count() once the last image completed
+    int64_t   start_ns;
+    int64_t   elapsed_ns; // Measured run time, 0 for the clock since start
+} Stats;
+
+/**
+ * Records a single sample of ns nanoseconds.
+ */
+void
+histogram_add(Histogram* histogram, int64_t ns);
+
+/**
+ * Returns the value below which the fraction p of samples fall.
+ */
+int64_t
+histogram_percentile(const Histogram* histogram, double p);
+
+/**
+ * Resets stats and starts the throughput clock.
+ */
+void
+stats_init(Stats* stats);
+
+/**
+ * Records the stage timings of a completed job, with output_ns the time it
+ * took to report it.  The end to end frame latency runs from the start of
+ * its decode until now.  A negative decode_ns or output_ns marks a stage
+ * that did not run for this job and is not recorded.
+ */
+void
+stats_add_job(Stats* stats, const Job* job, int64_t output_ns);
+
+/**
+ * Returns the printable name of stage.
+ */
+const char*
+stats_stage_name(StatStage stage);
+
+/**
+ * Returns the run time in seconds used for the throughput figures.
+ */
+double
+stats_seconds(const Stats* stats);
+
+/**
+ * Prints the p50/p90/p99/max of every stage that recorded samples along
+ * with images/sec and faces/sec to out.
+ */
+void
+stats_print(const Stats* stats, FILE* out);
+
+#endif /* STATS_H */
@@ -0,0 +1,188 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "vaal.h"
+
+typedef struct {
+    const char* name;
+    const char* key;
+    int64_t     start_ns;
+    int64_t     end_ns;
+    int64_t     value;
+} TraceEvent;
+
+// The events of one thread.  Only the owner writes them, count is published
+// so the buffer could be read while the thread still runs.
+typedef struct TraceBuffer {
+    struct TraceBuffer*  next;
+    long                 tid;
+    atomic_uint_fast64_t count; // Events ever recorded
+    TraceEvent           events[TRACE_EVENTS];
+} TraceBuffer;
+
+bool trace_enabled = false;
+
+static const char*           trace_path;
+static int64_t               trace_start_ns;
+static _Atomic(TraceBuffer*) buffers;      // Buffer of every thread
+static __thread TraceBuffer* local;        // Buffer of the calling thread
+static __thread bool         local_failed; // Its allocation failed
+
+// Allocates the buffer of the calling thread and pushes it onto the list
+// walked by trace_close().
+static TraceBuffer*
+local_buffer(void)
+{
+    if (local || local_failed) return local;
+
+    local = calloc(1, sizeof(TraceBuffer));
+    if (!local) {
+        local_failed = true;
+        return NULL;
+    }
+    local->tid = syscall(SYS_gettid);
+
+    TraceBuffer* head = atomic_load_explicit(&buffers, memory_order_relaxed);
+    do {
+        local->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&buffers,
+                                                    &head,
+                                                    local,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+    return local;
+}
+
+int
+trace_open(const char* path)
+{
+    // Fail now rather than after a whole run.
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fclose(out);
+
+    trace_path     = path;
+    trace_start_ns = vaal_clock_now();
+    trace_enabled  = true;
+    return 0;
+}
+
+void
+trace_record(const char* name,
+             int64_t     start_ns,
+             int64_t     end_ns,
+             const char* key,
+             int64_t     value)
+{
+    TraceBuffer* buffer = local_buffer();
+    if (!buffer) return;
+
+    uint64_t count =
+        atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    TraceEvent* event = &buffer->events[count % TRACE_EVENTS];
+    event->name       = name;
+    event->key        = key;
+    event->start_ns   = start_ns;
+    event->end_ns     = end_ns;
+    event->value      = value;
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+int
+trace_close(void)
+{
+    if (!trace_enabled) return 0;
+    trace_enabled = false;
+
+    FILE* out = fopen(trace_path, "w");
+    if (!out) {
+        fprintf(stderr,
+                "failed to open %s: %s\n",
+                trace_path,
+                strerror(errno));
+        return -1;
+    }
+
+    // Complete events in microseconds since trace_open(), one track per
+    // thread of this process.
+    const char* separator = "\n";
+    long        pid       = getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    TraceBuffer* buffer = atomic_load_explicit(&buffers, memory_order_acquire);
+    while (buffer) {
+        uint64_t count =
+            atomic_load_explicit(&buffer->count, memory_order_acquire);
+        uint64_t first = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+
+        for (uint64_t i = first; i < count; i++) {
+            const TraceEvent* event = &buffer->events[i % TRACE_EVENTS];
+            fprintf(out,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,"
+                    "\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+                    separator,
+                    event->name,
+                    pid,
+                    buffer->tid,
+                    (event->start_ns - trace_start_ns) / 1e3,
+                    (event->end_ns - event->start_ns) / 1e3);
+            if (event->key) {
+                fprintf(out,
+                        ",\"args\":{\"%s\":%lld}",
+                        event->key,
+                        (long long) event->value);
+            }
+            fprintf(out, "}");
+            separator = ",\n";
+        }
+        if (first) {
+            fprintf(stderr,
+                    "trace: thread %ld dropped its %llu oldest events\n",
+                    buffer->tid,
+                    (unsigned long long) first);
+        }
+
+        TraceBuffer* next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+    atomic_store_explicit(&buffers, NULL, memory_order_relaxed);
+    local = NULL;
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out)) {
+        fprintf(stderr,
+                "failed to write %s: %s\n",
+                trace_path,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Events kept per thread, the oldest are overwritten once it is full.
+#define TRACE_EVENTS (1 << 16)
+
+/**
+ * Whether trace_open() enabled tracing, checked before recording anything
+ * so the spans cost a single branch when tracing is off.
+ */
+extern bool trace_enabled;
+
+/**
+ * Starts recording spans, written to path as Chrome trace event JSON by
+ * trace_close().  Must be called before any thread records a span.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+trace_open(const char* path);
+
+/**
+ * Records a span of the calling thread from start_ns to end_ns on the
+ * vaal_clock_now() clock, with an argument key of value when key is not
+ * NULL.  name and key must be string literals or otherwise outlive the
+ * trace.  Every thread appends to a buffer of its own without locking.
+ */
+void
+trace_record(const char* name,
+             int64_t     start_ns,
+             int64_t     end_ns,
+             const char* key,
+             int64_t     value);
+
+/**
+ * Records the span name from start_ns to end_ns when tracing is enabled.
+ */
+static inline void
+trace_span(const char* name, int64_t start_ns, int64_t end_ns)
+{
+    if (trace_enabled) trace_record(name, start_ns, end_ns, NULL, 0);
+}
+
+/**
+ * Records the span name from start_ns to end_ns with the argument key of
+ * value, such as the face it belongs to, when tracing is enabled.
+ */
+static inline void
+trace_span_arg(const char* name,
+               int64_t     start_ns,
+               int64_t     end_ns,
+               const char* key,
+               int64_t     value)
+{
+    if (trace_enabled) trace_record(name, start_ns, end_ns, key, value);
+}
+
+/**
+ * Writes the spans still held by every thread to the path given to
+ * trace_open() and stops tracing.  The threads that recorded them must be
+ * done.  Does nothing when tracing was not enabled.
+ *
+ * Returns 0 on success or -1 after reporting the failure on stderr.
+ */
+int
+trace_close(void);
+
+#endif /* TRACE_H */
@@ -0,0 +1,203 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracker.h"
+
+static float
+box_iou(const VAALBox* a, const VAALBox* b)
+{
+    float w = MIN(a->xmax, b->xmax) - MAX(a->xmin, b->xmin);
+    float h = MIN(a->ymax, b->ymax) - MAX(a->ymin, b->ymin);
+    if (w <= 0.0f || h <= 0.0f) return 0.0f;
+
+    float inter = w * h;
+    float area  = (a->xmax - a->xmin) * (a->ymax - a->ymin) +
+                 (b->xmax - b->xmin) * (b->ymax - b->ymin) - inter;
+    return area > 0.0f ? inter / area : 0.0f;
+}
+
+// Box of track after frames more frames of constant motion.
+static VAALBox
+track_predict(const Track* track, int frames)
+{
+    VAALBox box = track->box;
+    box.xmin += track->velocity[0] * frames;
+    box.ymin += track->velocity[1] * frames;
+    box.xmax += track->velocity[2] * frames;
+    box.ymax += track->velocity[3] * frames;
+    return box;
+}
+
+int
+tracker_init(Tracker* tracker, size_t capacity, float iou_thr, int interval)
+{
+    memset(tracker, 0, sizeof(*tracker));
+    // Missed tracks are kept alongside the faces of the current frame.
+    tracker->capacity = capacity * 2;
+    tracker->tracks   = calloc(tracker->capacity, sizeof(Track));
+    tracker->scratch  = calloc(tracker->capacity, sizeof(Track));
+    tracker->next_id  = 1;
+    tracker->iou_thr  = iou_thr;
+    tracker->interval = MAX(interval, 1);
+
+    if (!tracker->tracks || !tracker->scratch) {
+        tracker_release(tracker);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+tracker_release(Tracker* tracker)
+{
+    free(tracker->tracks);
+    free(tracker->scratch);
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+bool
+tracker_wants_detection(const Tracker* tracker)
+{
+    return tracker->num_tracks == 0 || tracker->unstable ||
+           tracker->since_detect + 1 >= tracker->interval;
+}
+
+void
+tracker_update(Tracker*       tracker,
+               const VAALBox* boxes,
+               size_t         num_boxes,
+               uint32_t*      ids)
+{
+    size_t num_tracks = tracker->num_tracks;
+    size_t count      = 0;
+    int    matches[num_tracks ? num_tracks : 1];
+    float  ious[num_tracks ? num_tracks : 1];
+
+    tracker->unstable     = false;
+    tracker->since_detect = 0;
+
+    for (size_t i = 0; i < num_tracks; i++) matches[i] = -1;
+    for (size_t j = 0; j < num_boxes; j++) ids[j] = 0;
+
+    // Greedy assignment, the best remaining pair is matched first.
+    for (;;) {
+        float  best = tracker->iou_thr;
+        size_t best_track = 0, best_box = 0;
+        bool   found = false;
+
+        for (size_t i = 0; i < num_tracks; i++) {
+            if (matches[i] >= 0) continue;
+            const Track* track     = &tracker->tracks[i];
+            VAALBox      predicted = track_predict(track, track->age + 1);
+            for (size_t j = 0; j < num_boxes; j++) {
+                if (ids[j]) continue;
+                float iou = box_iou(&predicted, &boxes[j]);
+                if (iou >= best) {
+                    best       = iou;
+                    best_track = i;
+                    best_box   = j;
+                    found      = true;
+                }
+            }
+        }
+        if (!found) break;
+
+        matches[best_track] = best_box;
+        ious[best_track]    = best;
+        ids[best_box]       = tracker->tracks[best_track].id;
+    }
+
+    for (size_t i = 0; i < num_tracks; i++) {
+        Track* track = &tracker->tracks[i];
+        Track* next  = &tracker->scratch[count];
+
+        if (matches[i] < 0) {
+            // Keep a missed face for a while so a single missed detection
+            // does not give it a new identifier.
+            tracker->unstable = true;
+            if (track->misses + 1 > TRACKER_MAX_MISSES) continue;
+            *next = *track;
+            next->misses++;
+            next->age++;
+            count++;
+            continue;
+        }
+
+        const VAALBox* box    = &boxes[matches[i]];
+        float          frames = track->age + 1;
+        float          motion[4] = {
+            (box->xmin - track->box.xmin) / frames,
+            (box->ymin - track->box.ymin) / frames,
+            (box->xmax - track->box.xmax) / frames,
+            (box->ymax - track->box.ymax) / frames,
+        };
+
+        *next = *track;
+        for (int k = 0; k < 4; k++) {
+            next->velocity[k] = 0.5f * (track->velocity[k] + motion[k]);
+        }
+        next->box        = *box;
+        next->confidence = ious[i];
+        next->age        = 0;
+        next->misses     = 0;
+        if (ious[i] < TRACKER_MIN_CONFIDENCE) tracker->unstable = true;
+        count++;
+    }
+
+    for (size_t j = 0; j < num_boxes; j++) {
+        if (ids[j]) continue;
+        tracker->unstable = true;
+        if (count == tracker->capacity) continue;
+
+        Track* track = &tracker->scratch[count++];
+        memset(track, 0, sizeof(*track));
+        track->id         = tracker->next_id++;
+        track->box        = boxes[j];
+        track->confidence = 1.0f;
+        ids[j]            = track->id;
+    }
+
+    Track* tracks       = tracker->tracks;
+    tracker->tracks     = tracker->scratch;
+    tracker->scratch    = tracks;
+    tracker->num_tracks = count;
+}
+
+size_t
+tracker_predict(Tracker* tracker, VAALBox* boxes, uint32_t* ids)
+{
+    size_t count = 0;
+
+    tracker->since_detect++;
+    for (size_t i = 0; i < tracker->num_tracks; i++) {
+        Track* track = &tracker->tracks[i];
+        track->age++;
+        // Faces missing from the last detection are only kept to be
+        // matched again, they have no box worth estimating the pose of.
+        if (track->misses) continue;
+        boxes[count] = track_predict(track, track->age);
+        ids[count]   = track->id;
+        count++;
+    }
+
+    return count;
+}
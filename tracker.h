@@ -0,0 +1,108 @@
+/**
+ * Copyright 2022 by Au-Zone Technologies.  All Rights Reserved.
+ *
+ * Software that is described herein is for illustrative purposes only which
+ * provides customers with programming information regarding the DeepView VAAL
+ * library. This software is supplied "AS IS" without any warranties of any
+ * kind, and Au-Zone Technologies and its licensor disclaim any and all
+ * warranties, express or implied, including all implied warranties of
+ * merchantability, fitness for a particular purpose and non-infringement of
+ * intellectual property rights.  Au-Zone Technologies assumes no responsibility
+ * or liability for the use of the software, conveys no license or rights under
+ * any patent, copyright, mask work right, or any other intellectual property
+ * rights in or to any products. Au-Zone Technologies reserves the right to make
+ * changes in the software without notification. Au-Zone Technologies also makes
+ * no representation or warranty that such application will be suitable for the
+ * specified use without further testing or modification.
+ */
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vaal.h"
+
+// Detections a track may miss before it is forgotten.
+#define TRACKER_MAX_MISSES 2
+
+// Lowest IoU between a predicted and a detected box still considered a
+// steady track, below it detection runs again on the next frame.
+#define TRACKER_MIN_CONFIDENCE 0.5f
+
+/**
+ * A face followed across frames.
+ */
+typedef struct {
+    uint32_t id;          // Stable identifier, never reused
+    VAALBox  box;         // Box at the last detection
+    float    velocity[4]; // Motion of xmin, ymin, xmax, ymax per frame
+    float    confidence;  // IoU of the prediction with the last detection
+    int      age;         // Frames since the last detection
+    int      misses;      // Consecutive detections without a match
+} Track;
+
+/**
+ * Associates face boxes across consecutive frames by IoU so every face
+ * keeps its identifier, and predicts the boxes of frames on which the face
+ * detector is skipped from the motion seen between detections.
+ */
+typedef struct {
+    Track*   tracks;
+    Track*   scratch;      // Tracks being rebuilt by tracker_update()
+    size_t   num_tracks;
+    size_t   capacity;
+    uint32_t next_id;
+    float    iou_thr;      // Minimum IoU for a box to continue a track
+    int      interval;     // Detect at least every interval frames
+    int      since_detect; // Frames predicted since the last detection
+    bool     unstable;     // Faces appeared, vanished or moved unexpectedly
+} Tracker;
+
+/**
+ * Prepares tracker for up to capacity faces per frame, matching boxes whose
+ * IoU is at least iou_thr and asking for detection every interval frames.
+ *
+ * Returns 0 on success or -1 when out of memory.
+ */
+int
+tracker_init(Tracker* tracker, size_t capacity, float iou_thr, int interval);
+
+/**
+ * Releases the tracks held by tracker.
+ */
+void
+tracker_release(Tracker* tracker);
+
+/**
+ * Whether the next frame needs the face detector: the interval is up,
+ * there is nothing to track or the last detection did not follow the
+ * predicted tracks closely.
+ */
+bool
+tracker_wants_detection(const Tracker* tracker);
+
+/**
+ * Associates the detected boxes with the tracks, greedily by highest IoU,
+ * and writes the track identifier of every box to ids.  Boxes continuing
+ * no track start a new one.
+ */
+void
+tracker_update(Tracker*       tracker,
+               const VAALBox* boxes,
+               size_t         num_boxes,
+               uint32_t*      ids);
+
+/**
+ * Advances every track by one frame without detection and writes the
+ * predicted boxes and their identifiers.
+ *
+ * Returns the number of boxes written, at most as many as the last detection
+ * found.
+ */
+size_t
+tracker_predict(Tracker* tracker, VAALBox* boxes, uint32_t* ids);
+
+#endif /* TRACKER_H */